@@ -2,7 +2,25 @@
  //                uses the rpi-rgb-led-marix library
  // Copyright (C) 2018 John Davies
  //
- // Usage: blinkpanel [ rpi-rgb-led-marix options ]
+ // Usage: blinkpanel [ rpi-rgb-led-marix options ] [ -g crop|scale ] [ -l layout file ]
+ //
+ //   -g crop   frames are drawn from the top left and anything that
+ //             doesn't fit is cut off (default)
+ //   -g scale  frames are scaled to fill the wall
+ //   -l file   layout of the panels in the wall, without one the wall is
+ //             the whole canvas as set by the rpi-rgb-led-marix options
+ //
+ // A layout file describes one large image, the wall, and which part of
+ // it each panel shows.  Each tile gives a part of the wall, where it
+ // goes on the canvas and how far it is turned clockwise, so a chain or
+ // grid of panels can show one stream.  For example, two 64x32 panels
+ // chained as a 64x64 wall with the second one upside down:
+ //
+ //   # wall <width> <height>
+ //   wall 64 64
+ //   # tile <wall x> <wall y> <width> <height> <canvas x> <canvas y> [0|90|180|270]
+ //   tile 0 0 64 32 0 0
+ //   tile 0 32 64 32 64 0 180
  //
 
  // This program is free software: you can redistribute it and/or modify
@@ -19,19 +37,102 @@
  // along with this program.  If not, see <http://www.gnu.org/licenses/>
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 #include <blib/blib.h>
 #include "led-matrix-c.h"
 
+// Packets are decoded on the GLib main loop and handed to a render
+// thread, which waits for vsync, through three frame slots.  The
+// receiver always has one to fill, the render thread has the one being
+// shown and the third holds the latest finished frame.  If another frame
+// is finished before that one is shown it takes its place, so the panel
+// always shows the newest frame and the receiver never waits for the
+// panel
+#define FRAME_SLOTS 3
+// Set in ready when the frame it points to hasn't been shown yet
+#define FRAME_NEW 0x4
+// Frames shown more than this long after they arrived are counted as late
+#define LATE_US 50000
+// How often the render thread checks for the end when no frames arrive
+#define WAIT_NS 100000000
+// Most tiles in a layout file
+#define MAX_TILES 64
+#define LINE_LENGTH 256
+
+typedef struct
+{
+  gint64 received;      // g_get_monotonic_time() when decoded
+  struct Color *pixels; // panel_width * panel_height, row by row
+} frame_t;
+
+// Part of the wall shown on one panel
+typedef struct
+{
+  int x, y;             // in the wall
+  int width, height;    // in the wall
+  int canvas_x, canvas_y;
+  int rotation;         // clockwise degrees, 0, 90, 180 or 270
+} tile_t;
+
+// 8 bit RGB packet rows are copied straight into frames
+_Static_assert( sizeof( struct Color ) == 3, "struct Color is not packed RGB" );
 
 struct RGBLedMatrixOptions options;
 struct RGBLedMatrix *matrix;
 struct LedCanvas *canvas;
+int panel_width;
+int panel_height;
+
+frame_t frames[FRAME_SLOTS];
+atomic_int ready = 1;   // latest frame, plus FRAME_NEW
+int back = 0;           // being filled by the receiver
+int front = 2;          // being shown by the render thread
+sem_t frame_posted;
+atomic_int running = 1;
 
+// The driver double buffers, so the offscreen canvas holds the frame from
+// two swaps ago.  A copy of what each canvas holds lets only the pixels
+// that differ be written, and a frame the same as the one on the panel
+// isn't swapped at all.  A canvas is drawn in full until its copy is
+// known
+struct Color *canvas_copy[2];
+int copy_valid[2] = { 0, 0 };
+int drawing = 0;        // canvas_copy index of the offscreen canvas
+
+// Counters, each only changed by one thread
 int packets = 0;
+int dropped = 0;        // packets that couldn't be shown
+int coalesced = 0;      // frames replaced by a newer one before being shown
+int shown = 0;
+int late = 0;
+int unchanged = 0;      // frames the same as the one on the panel
 int *dummy_data;
 
+// Geometry, the wall defaults to the whole canvas
+enum { GEOMETRY_CROP, GEOMETRY_SCALE } geometry = GEOMETRY_CROP;
+int wall_width;
+int wall_height;
+tile_t tiles[MAX_TILES];
+int tile_count = 0;
+gboolean have_layout = FALSE;
+// Packet pixel shown at each canvas pixel, -1 for black.  Rebuilt when
+// the packet size changes
+int *pixel_map = NULL;
+int map_width = 0;
+int map_height = 0;
+
+// Packet values scaled from 0..maxval to 0..255, rebuilt when maxval changes
+unsigned char scale[256];
+int scale_maxval = 0;
+
 static GMainLoop *loop = NULL;
 
 // ------------------------------------------------------------------------
@@ -47,66 +148,420 @@ static void InterruptHandler( int signo )
 }
 
 // ------------------------------------------------------------------------
-// Blinkenlight packet processor
+// Fill the scale table for a maxval, values above it are shown at full
+// brightness
 
-static gboolean frame_callback( BReceiver *receiver, BPacket *packet, gpointer data )
+static void make_scale( int maxVal )
 {
-  int row, column, maxVal, r, g, b;
-  gboolean rgb = FALSE;
+  int i;
 
-  // Check for colour frame
-  if( packet->header.mcu_frame_h.channels == 3 )
+  for( i=0; i<256; i++ )
   {
-    rgb = TRUE;
+    scale[i] = ( i >= maxVal ) ? 255 : ( i * 255 ) / maxVal;
   }
+  scale_maxval = maxVal;
+}
 
-  // Panel setup
-  led_canvas_clear( canvas );
+// ------------------------------------------------------------------------
+// Read a layout file into the wall size and tiles, returns FALSE if it
+// can't be read or doesn't fit the canvas
+
+static gboolean read_layout( const char *file_name )
+{
+  char line[LINE_LENGTH];
+  int line_number = 0;
+  FILE *layout_file = fopen( file_name, "r" );
 
-  // Check data sizes
-  if( ( packet->header.mcu_frame_h.height <= options.rows ) &&
-      ( packet->header.mcu_frame_h.width <= options.cols ) )
+  if( layout_file == NULL )
   {
-    // Packet will fit on display so copy data
-    maxVal = packet->header.mcu_frame_h.maxval;
+    printf( "ERROR - failed to open layout file: %s\n", file_name );
+    return FALSE;
+  }
+  wall_width = 0;
+  wall_height = 0;
+  while( fgets( line, sizeof( line ), layout_file ) != NULL )
+  {
+    char keyword[16];
+    tile_t tile;
 
-    for( row=0; row<packet->header.mcu_frame_h.height; row++ )
+    line_number++;
+    if( ( sscanf( line, "%15s", keyword ) != 1 ) || ( keyword[0] == '#' ) )
+    {
+      continue;
+    }
+    if( strcmp( keyword, "wall" ) == 0 )
+    {
+      if( ( sscanf( line, "%*s %d %d", &wall_width, &wall_height ) != 2 ) ||
+          ( wall_width <= 0 ) || ( wall_height <= 0 ) )
+      {
+        printf( "ERROR - layout line %d: wall needs a width and height\n", line_number );
+        fclose( layout_file );
+        return FALSE;
+      }
+    }
+    else if( strcmp( keyword, "tile" ) == 0 )
     {
-      for( column=0; column<packet->header.mcu_frame_h.width; column++ )
+      tile.rotation = 0;
+      if( sscanf( line, "%*s %d %d %d %d %d %d %d", &tile.x, &tile.y, &tile.width, &tile.height,
+                  &tile.canvas_x, &tile.canvas_y, &tile.rotation ) < 6 )
+      {
+        printf( "ERROR - layout line %d: tile needs x, y, width, height, canvas x and canvas y\n", line_number );
+        fclose( layout_file );
+        return FALSE;
+      }
+      // Turned a quarter the tile is as high on the canvas as it is wide
+      // in the wall
+      int turned = ( tile.rotation == 90 ) || ( tile.rotation == 270 );
+      int canvas_width = turned ? tile.height : tile.width;
+      int canvas_height = turned ? tile.width : tile.height;
+      if( ( tile.rotation % 90 != 0 ) || ( tile.rotation < 0 ) || ( tile.rotation > 270 ) )
+      {
+        printf( "ERROR - layout line %d: rotation must be 0, 90, 180 or 270\n", line_number );
+        fclose( layout_file );
+        return FALSE;
+      }
+      if( wall_width == 0 )
+      {
+        printf( "ERROR - layout line %d: wall must come before the tiles\n", line_number );
+        fclose( layout_file );
+        return FALSE;
+      }
+      if( ( tile.width <= 0 ) || ( tile.height <= 0 ) ||
+          ( tile.x < 0 ) || ( tile.y < 0 ) ||
+          ( tile.x + tile.width > wall_width ) || ( tile.y + tile.height > wall_height ) )
+      {
+        printf( "ERROR - layout line %d: tile is not inside the wall\n", line_number );
+        fclose( layout_file );
+        return FALSE;
+      }
+      if( ( tile.canvas_x < 0 ) || ( tile.canvas_y < 0 ) ||
+          ( tile.canvas_x + canvas_width > panel_width ) || ( tile.canvas_y + canvas_height > panel_height ) )
+      {
+        printf( "ERROR - layout line %d: tile is not inside the %d x %d canvas\n", line_number,
+                panel_width, panel_height );
+        fclose( layout_file );
+        return FALSE;
+      }
+      if( tile_count == MAX_TILES )
       {
-        if( rgb == FALSE )
+        printf( "ERROR - layout line %d: more than %d tiles\n", line_number, MAX_TILES );
+        fclose( layout_file );
+        return FALSE;
+      }
+      tiles[tile_count++] = tile;
+    }
+    else
+    {
+      printf( "ERROR - layout line %d: unknown keyword %s\n", line_number, keyword );
+      fclose( layout_file );
+      return FALSE;
+    }
+  }
+  fclose( layout_file );
+  if( tile_count == 0 )
+  {
+    printf( "ERROR - no tiles in layout file: %s\n", file_name );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// ------------------------------------------------------------------------
+// Work out which packet pixel each canvas pixel shows for a packet size.
+// Wall positions are turned into packet positions in 16.16 fixed point
+// when scaling
+
+static void make_pixel_map( int width, int height )
+{
+  int i, t, u, v;
+  int64_t x_step = 1 << 16;
+  int64_t y_step = 1 << 16;
+
+  if( geometry == GEOMETRY_SCALE )
+  {
+    x_step = ( (int64_t)width << 16 ) / wall_width;
+    y_step = ( (int64_t)height << 16 ) / wall_height;
+  }
+  for( i=0; i<panel_width * panel_height; i++ )
+  {
+    pixel_map[i] = -1;
+  }
+  for( t=0; t<tile_count; t++ )
+  {
+    const tile_t *tile = &tiles[t];
+    int turned = ( tile->rotation == 90 ) || ( tile->rotation == 270 );
+    int canvas_width = turned ? tile->height : tile->width;
+    int canvas_height = turned ? tile->width : tile->height;
+
+    for( v=0; v<canvas_height; v++ )
+    {
+      for( u=0; u<canvas_width; u++ )
+      {
+        int x, y;
+
+        // Back from the canvas to the wall
+        switch( tile->rotation )
         {
-          // Monochrome
-          r = ( ( packet->data[ ( row * packet->header.mcu_frame_h.width ) + column ] ) * 255 ) / maxVal;
-          g = r;
-          b = r;
+          case 90:
+            x = v;
+            y = tile->height - 1 - u;
+            break;
+          case 180:
+            x = tile->width - 1 - u;
+            y = tile->height - 1 - v;
+            break;
+          case 270:
+            x = tile->width - 1 - v;
+            y = u;
+            break;
+          default:
+            x = u;
+            y = v;
+            break;
         }
-        else
+        // And from the wall to the packet
+        x = ( ( tile->x + x ) * x_step ) >> 16;
+        y = ( ( tile->y + y ) * y_step ) >> 16;
+        if( ( x < width ) && ( y < height ) )
         {
-          // RGB
-          r = ( ( packet->data[ ( row * packet->header.mcu_frame_h.width * packet->header.mcu_frame_h.channels ) + ( column * packet->header.mcu_frame_h.channels ) ] ) * 255 ) / maxVal;
-          g = ( ( packet->data[ ( row * packet->header.mcu_frame_h.width * packet->header.mcu_frame_h.channels ) + ( column * packet->header.mcu_frame_h.channels ) + 1 ] ) * 255 ) / maxVal;
-          b = ( ( packet->data[ ( row * packet->header.mcu_frame_h.width * packet->header.mcu_frame_h.channels ) + ( column * packet->header.mcu_frame_h.channels ) + 2 ] ) * 255 ) / maxVal;
+          pixel_map[( ( tile->canvas_y + v ) * panel_width ) + tile->canvas_x + u] = ( y * width ) + x;
         }
-        led_canvas_set_pixel( canvas, column, row, r, g, b );
       }
     }
   }
+  map_width = width;
+  map_height = height;
+}
+
+// ------------------------------------------------------------------------
+// Convert a packet into a frame of RGB pixels, returns FALSE if it
+// can't be shown
+
+static gboolean decode_packet( BPacket *packet, frame_t *frame )
+{
+  int row, column, maxVal;
+  int width = packet->header.mcu_frame_h.width;
+  int height = packet->header.mcu_frame_h.height;
+  int channels = packet->header.mcu_frame_h.channels;
+  const guchar *data = packet->data;
+
+  maxVal = packet->header.mcu_frame_h.maxval;
+  if( ( width == 0 ) || ( height == 0 ) || ( maxVal == 0 ) ||
+      ( ( channels != 1 ) && ( channels != 3 ) ) )
+  {
+    return FALSE;
+  }
+  if( maxVal != scale_maxval )
+  {
+    make_scale( maxVal );
+  }
 
-  //led_canvas_set_pixel( canvas, packets % 64, packets / 64, 128, 128, 128 );
-  // Write to panel
-  canvas = led_matrix_swap_on_vsync( matrix, canvas );
+  // Packets that go straight onto the canvas are copied a row at a time,
+  // anything else goes through the pixel map
+  if( have_layout || ( width > panel_width ) || ( height > panel_height ) ||
+      ( ( geometry == GEOMETRY_SCALE ) && ( ( width != panel_width ) || ( height != panel_height ) ) ) )
+  {
+    struct Color *p = frame->pixels;
+    int i;
+
+    if( ( width != map_width ) || ( height != map_height ) )
+    {
+      make_pixel_map( width, height );
+    }
+    for( i=0; i<panel_width * panel_height; i++ )
+    {
+      int source = pixel_map[i];
+
+      if( source < 0 )
+      {
+        p[i].r = p[i].g = p[i].b = 0;
+      }
+      else if( channels == 3 )
+      {
+        p[i].r = scale[data[source * 3]];
+        p[i].g = scale[data[( source * 3 ) + 1]];
+        p[i].b = scale[data[( source * 3 ) + 2]];
+      }
+      else
+      {
+        p[i].r = p[i].g = p[i].b = scale[data[source]];
+      }
+    }
+    return TRUE;
+  }
+
+  // Anything outside the packet is black
+  if( ( width < panel_width ) || ( height < panel_height ) )
+  {
+    memset( frame->pixels, 0, panel_width * panel_height * sizeof( struct Color ) );
+  }
+  for( row=0; row<height; row++ )
+  {
+    struct Color *p = frame->pixels + ( row * panel_width );
+
+    if( ( channels == 3 ) && ( maxVal == 255 ) )
+    {
+      // 8 bit RGB needs no scaling
+      memcpy( p, data, width * 3 );
+      data += width * 3;
+    }
+    else if( channels == 3 )
+    {
+      // RGB
+      for( column=0; column<width; column++ )
+      {
+        p[column].r = scale[data[0]];
+        p[column].g = scale[data[1]];
+        p[column].b = scale[data[2]];
+        data += 3;
+      }
+    }
+    else
+    {
+      // Monochrome
+      for( column=0; column<width; column++ )
+      {
+        p[column].r = p[column].g = p[column].b = scale[*data++];
+      }
+    }
+  }
+  return TRUE;
+}
+
+// ------------------------------------------------------------------------
+// Blinkenlight packet processor, the frame is decoded and made the
+// latest one without waiting for the panel
+
+static gboolean frame_callback( BReceiver *receiver, BPacket *packet, gpointer data )
+{
+  frame_t *frame = &frames[back];
 
   packets++;
+  if( !decode_packet( packet, frame ) )
+  {
+    dropped++;
+    return TRUE;
+  }
+  frame->received = g_get_monotonic_time();
+
+  // Swap the finished frame for the latest one, which is reused if it
+  // was never shown
+  int previous = atomic_exchange( &ready, back | FRAME_NEW );
+  if( previous & FRAME_NEW )
+  {
+    coalesced++;
+  }
+  back = previous & ~FRAME_NEW;
+  sem_post( &frame_posted );
+
   return TRUE;
 }
 
 // ------------------------------------------------------------------------
 
+static inline gboolean same_colour( const struct Color *a, const struct Color *b )
+{
+  return ( a->r == b->r ) && ( a->g == b->g ) && ( a->b == b->b );
+}
+
+// ------------------------------------------------------------------------
+// Copy a frame to the offscreen canvas.  Rows are compared with what the
+// canvas already holds and only the span from the first to the last
+// changed pixel of each row is written
+
+static void draw_frame( frame_t *frame )
+{
+  int row, first, last;
+  struct Color *copy = canvas_copy[drawing];
+  size_t row_bytes = panel_width * sizeof( struct Color );
+
+  if( !copy_valid[drawing] )
+  {
+    led_canvas_set_pixels( canvas, 0, 0, panel_width, panel_height, frame->pixels );
+    memcpy( copy, frame->pixels, row_bytes * panel_height );
+    copy_valid[drawing] = 1;
+    return;
+  }
+  for( row=0; row<panel_height; row++ )
+  {
+    struct Color *p = frame->pixels + ( row * panel_width );
+    struct Color *c = copy + ( row * panel_width );
+
+    if( memcmp( p, c, row_bytes ) == 0 )
+    {
+      continue;
+    }
+    first = 0;
+    while( same_colour( &p[first], &c[first] ) )
+    {
+      first++;
+    }
+    last = panel_width - 1;
+    while( same_colour( &p[last], &c[last] ) )
+    {
+      last--;
+    }
+    led_canvas_set_pixels( canvas, first, row, last - first + 1, 1, p + first );
+    memcpy( c + first, p + first, ( last - first + 1 ) * sizeof( struct Color ) );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Show each new frame, paced by the panel's vsync
+
+static void *render_thread( void *arg )
+{
+  while( atomic_load( &running ) )
+  {
+    struct timespec ts;
+    clock_gettime( CLOCK_REALTIME, &ts );
+    ts.tv_nsec += WAIT_NS;
+    if( ts.tv_nsec >= 1000000000 )
+    {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    if( sem_timedwait( &frame_posted, &ts ) != 0 )
+    {
+      continue;
+    }
+    // Posts for frames that were replaced before being shown leave
+    // nothing new to take
+    if( !( atomic_load( &ready ) & FRAME_NEW ) )
+    {
+      continue;
+    }
+    front = atomic_exchange( &ready, front ) & ~FRAME_NEW;
+    // Nothing to do if the panel already shows this
+    if( copy_valid[!drawing] &&
+        ( memcmp( frames[front].pixels, canvas_copy[!drawing],
+                  panel_width * panel_height * sizeof( struct Color ) ) == 0 ) )
+    {
+      unchanged++;
+      continue;
+    }
+    draw_frame( &frames[front] );
+    // Write to panel
+    canvas = led_matrix_swap_on_vsync( matrix, canvas );
+    drawing = !drawing;
+    shown++;
+    if( g_get_monotonic_time() - frames[front].received > LATE_US )
+    {
+      late++;
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+
 int main( int argc, char *argv[] )
 {
   BReceiver *receiver;
   gint bml_port = MCU_LISTENER_PORT;
+  pthread_t render_id;
+  int i, opt;
+  char *layout_file_name = NULL;
 
   // Set up blinkenlights receiver
   b_init();
@@ -127,6 +582,89 @@ int main( int argc, char *argv[] )
     return EXIT_FAILURE;
   }
   canvas = led_matrix_create_offscreen_canvas( matrix );
+  led_canvas_get_size( canvas, &panel_width, &panel_height );
+
+  // Options the matrix library didn't take
+  while( ( opt = getopt( argc, argv, "g:l:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'g':
+        if( strcmp( optarg, "crop" ) == 0 )
+        {
+          geometry = GEOMETRY_CROP;
+        }
+        else if( strcmp( optarg, "scale" ) == 0 )
+        {
+          geometry = GEOMETRY_SCALE;
+        }
+        else
+        {
+          printf( "ERROR - geometry must be crop or scale\n" );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'l':
+        layout_file_name = optarg;
+        break;
+      default:
+        printf( "  Usage is blinkpanel [ rpi-rgb-led-marix options ] [ -g crop|scale ] [ -l layout file ]\n" );
+        return EXIT_FAILURE;
+    }
+  }
+
+  // The wall is the whole canvas unless there is a layout
+  if( layout_file_name != NULL )
+  {
+    if( !read_layout( layout_file_name ) )
+    {
+      return EXIT_FAILURE;
+    }
+    have_layout = TRUE;
+  }
+  else
+  {
+    wall_width = panel_width;
+    wall_height = panel_height;
+    tiles[0].x = tiles[0].y = 0;
+    tiles[0].width = panel_width;
+    tiles[0].height = panel_height;
+    tiles[0].canvas_x = tiles[0].canvas_y = 0;
+    tiles[0].rotation = 0;
+    tile_count = 1;
+  }
+  pixel_map = malloc( panel_width * panel_height * sizeof( int ) );
+  if( pixel_map == NULL )
+  {
+    printf( "ERROR - malloc fail for pixel map\n" );
+    return EXIT_FAILURE;
+  }
+
+  // Frame slots for the whole panel
+  for( i=0; i<FRAME_SLOTS; i++ )
+  {
+    frames[i].pixels = calloc( panel_width * panel_height, sizeof( struct Color ) );
+    if( frames[i].pixels == NULL )
+    {
+      printf( "ERROR - malloc fail for frame buffers\n" );
+      return EXIT_FAILURE;
+    }
+  }
+  for( i=0; i<2; i++ )
+  {
+    canvas_copy[i] = malloc( panel_width * panel_height * sizeof( struct Color ) );
+    if( canvas_copy[i] == NULL )
+    {
+      printf( "ERROR - malloc fail for frame buffers\n" );
+      return EXIT_FAILURE;
+    }
+  }
+  sem_init( &frame_posted, 0, 0 );
+  if( pthread_create( &render_id, NULL, render_thread, NULL ) != 0 )
+  {
+    printf( "ERROR - could not start render thread\n" );
+    return EXIT_FAILURE;
+  }
 
   signal( SIGTERM, InterruptHandler );
   signal( SIGINT, InterruptHandler );
@@ -135,10 +673,24 @@ int main( int argc, char *argv[] )
   loop = g_main_loop_new (NULL, FALSE);
   g_main_loop_run (loop);
 
+  // Stop the render thread before the panel is cleared
+  atomic_store( &running, 0 );
+  pthread_join( render_id, NULL );
+
   // Print some stats and clear panel on exit
   printf( "\nClearing panel ...\n" );
   led_canvas_clear( canvas );
   led_matrix_delete( matrix );
   printf( "Packets: %d\n", packets );
+  printf( "Frames shown: %d, unchanged: %d, coalesced: %d, dropped: %d, late: %d\n",
+          shown, unchanged, coalesced, dropped, late );
+  for( i=0; i<FRAME_SLOTS; i++ )
+  {
+    free( frames[i].pixels );
+  }
+  free( canvas_copy[0] );
+  free( canvas_copy[1] );
+  free( pixel_map );
+  sem_destroy( &frame_posted );
   return EXIT_SUCCESS;
 }
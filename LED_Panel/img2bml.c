@@ -1,8 +1,27 @@
- // img2bml.c - a converter to create BML files from image files
+ // img2bml.c - a converter to create BML and BBM files from image files
  //
  // Copyright (C) 2018 John Davies
  //
- // Usage: img2bml <file name> [duration]
+ // Usage: img2bml [ -d duration ] [ -f bml|bbm|both ] [ -o output name ] [ -t threads ]
+ //                <file name> [ file name ... ] [ duration ]
+ //
+ //   Each file gives one frame, or all of its frames for an animated GIF,
+ //   so a sequence of images or a GIF becomes an animation.  All frames
+ //   must be the same size.  The duration of each frame is in ms, without
+ //   one GIF frames keep their own delays and everything else gets 100.
+ //   A number after the file names is taken as the duration, as it was
+ //   before the options.  The output is written to <output name>.bml
+ //   and / or <output name>.bbm, the output name defaults to the first
+ //   file name.  Frames are converted on all processors unless -t says
+ //   otherwise.
+ //
+ //   BBM is the binary Blinkenlights movie format, all numbers are big
+ //   endian:
+ //
+ //     magic 0x23542666, height, width, channels, maxval (16 bit each),
+ //     frame count, total duration in ms, offset of the frames (32 bit each),
+ //     "frms", then for each frame the duration in ms (16 bit) and
+ //     height * width * channels bytes
  //
 
  // This program is free software: you can redistribute it and/or modify
@@ -20,110 +39,596 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define DEFAULT_DURATION 100
+#define BBM_MAGIC 0x23542666
+#define BBM_HEADER_SIZE 24
+// Output files are written in blocks this big
+#define WRITE_BUFFER_SIZE ( 1024 * 1024 )
+
+typedef struct
+{
+  const char *file_name;      // still image, loaded when converted
+  const unsigned char *rgba;  // or a GIF frame that is already decoded
+  unsigned char *gif_data;    // set on the first frame of a GIF to free it
+  int duration;               // ms
+  unsigned char *packed;      // width * height * channels
+  char *text;                 // BML for the frame
+  size_t text_length;
+  const char *error;          // set if the frame couldn't be converted
+} frame_t;
+
+frame_t *frames = NULL;
+int frame_count = 0;
+int frames_allocated = 0;
+int width = 0;
+int height = 0;
+int channels = 1;
+int write_bml = 1;
+atomic_int next_frame = 0;
+// Two hex digits for each byte value
+char hex_digits[256][2];
 
 // ------------------------------------------------------------------------
+// Add a frame to the list, returns NULL if there is no memory for it
 
-int main( int argc, char *argv[] )
+static frame_t *add_frame( void )
 {
-  // Check for image file present
-  if( argc == 1 )
+  if( frame_count == frames_allocated )
   {
-    printf( "ERROR - no image file specified\n" );
-    printf( "  Usage is img2bml <file name> [duration]\n" );
-    return EXIT_FAILURE;
+    int new_size = ( frames_allocated == 0 ) ? 64 : frames_allocated * 2;
+    frame_t *new_frames = realloc( frames, new_size * sizeof( frame_t ) );
+    if( new_frames == NULL )
+    {
+      return NULL;
+    }
+    frames = new_frames;
+    frames_allocated = new_size;
   }
+  frame_t *frame = &frames[frame_count++];
+  memset( frame, 0, sizeof( frame_t ) );
+  return frame;
+}
 
-  // Try to read file
-  int rows, columns, n;
-  int channels;
-  int duration;
-  unsigned char *data = stbi_load( argv[1], &columns, &rows, &n, 0);
-  if( data == NULL )
+// ------------------------------------------------------------------------
+// Read a whole file, returns NULL if it can't be read
+
+static unsigned char *read_file( const char *file_name, long *length )
+{
+  FILE *file = fopen( file_name, "rb" );
+  unsigned char *buffer = NULL;
+
+  if( file == NULL )
   {
-    printf( "ERROR - failed to read file\n" );
-    return EXIT_FAILURE;
+    return NULL;
+  }
+  if( ( fseek( file, 0, SEEK_END ) == 0 ) && ( ( *length = ftell( file ) ) > 0 ) &&
+      ( fseek( file, 0, SEEK_SET ) == 0 ) )
+  {
+    buffer = malloc( *length );
+    if( ( buffer != NULL ) && ( fread( buffer, 1, *length, file ) != (size_t)*length ) )
+    {
+      free( buffer );
+      buffer = NULL;
+    }
   }
+  fclose( file );
+  return buffer;
+}
+
+// ------------------------------------------------------------------------
+// Check the size of each new image against the first one
 
-  // Check for duration needed
-  if( argv[2] != NULL )
+static int check_size( const char *file_name, int columns, int rows )
+{
+  if( frame_count == 0 )
   {
-    duration = atoi( argv[2] );
+    width = columns;
+    height = rows;
   }
-  // Check for error or set default
-  if( duration == 0 )
+  else if( ( columns != width ) || ( rows != height ) )
   {
-    duration = 100;
+    printf( "ERROR - %s is %d x %d, not %d x %d like the first frame\n",
+            file_name, columns, rows, width, height );
+    return 0;
   }
+  return 1;
+}
 
-  // Process data
-  printf( "Image data - " );
-  printf( "Rows: %d, ", rows );
-  printf( "Columns: %d, ", columns );
-  printf( "Depth: %d\n", n );
+// ------------------------------------------------------------------------
+// Add the frames from one file, GIFs are decoded here as all their
+// frames come from one call.  Other images are only checked, they are
+// loaded when converted
+
+static int add_file( const char *file_name, int duration )
+{
+  int columns, rows, n;
+  long length;
+  unsigned char *buffer = read_file( file_name, &length );
+
+  if( buffer == NULL )
+  {
+    printf( "ERROR - failed to read file: %s\n", file_name );
+    return 0;
+  }
+  if( ( length > 4 ) && ( memcmp( buffer, "GIF8", 4 ) == 0 ) )
+  {
+    int *delays = NULL;
+    int count, i;
+    unsigned char *data = stbi_load_gif_from_memory( buffer, length, &delays, &columns, &rows,
+                                                     &count, &n, 4 );
+    free( buffer );
+    if( data == NULL )
+    {
+      printf( "ERROR - failed to read file: %s\n", file_name );
+      return 0;
+    }
+    if( !check_size( file_name, columns, rows ) )
+    {
+      stbi_image_free( data );
+      free( delays );
+      return 0;
+    }
+    for( i=0; i<count; i++ )
+    {
+      frame_t *frame = add_frame();
+      if( frame == NULL )
+      {
+        printf( "ERROR - malloc fail for frames\n" );
+        return 0;
+      }
+      frame->rgba = data + ( (size_t)i * columns * rows * 4 );
+      frame->gif_data = ( i == 0 ) ? data : NULL;
+      // A GIF delay of 0 usually means as fast as possible
+      frame->duration = ( ( duration == 0 ) && ( delays != NULL ) && ( delays[i] > 0 ) ) ?
+                          delays[i] : duration;
+    }
+    free( delays );
+    channels = 3;
+    return 1;
+  }
 
-  // Setup output file
-  char *output_file_name = malloc( strlen( argv[1] ) + 5 );
-  if( output_file_name == NULL )
+  if( !stbi_info_from_memory( buffer, length, &columns, &rows, &n ) )
+  {
+    free( buffer );
+    printf( "ERROR - failed to read file: %s\n", file_name );
+    return 0;
+  }
+  free( buffer );
+  if( !check_size( file_name, columns, rows ) )
+  {
+    return 0;
+  }
+  frame_t *frame = add_frame();
+  if( frame == NULL )
+  {
+    printf( "ERROR - malloc fail for frames\n" );
+    return 0;
+  }
+  frame->file_name = file_name;
+  frame->duration = duration;
+  // Grey images, with or without alpha, stay grey unless a colour one
+  // is mixed in.  Alpha channels are ignored
+  if( n >= 3 )
+  {
+    channels = 3;
+  }
+  return 1;
+}
+
+// ------------------------------------------------------------------------
+// Pack a frame into the output channels and make its BML
+
+static void convert_frame( frame_t *frame )
+{
+  const unsigned char *source = frame->rgba;
+  unsigned char *data = NULL;
+  int n = 4;
+  int columns, rows, i, r;
+
+  if( source == NULL )
+  {
+    data = stbi_load( frame->file_name, &columns, &rows, &n, 0 );
+    if( data == NULL )
+    {
+      frame->error = "failed to read file";
+      return;
+    }
+    if( ( columns != width ) || ( rows != height ) )
+    {
+      stbi_image_free( data );
+      frame->error = "frame size changed";
+      return;
+    }
+    source = data;
+  }
+
+  size_t pixels = (size_t)width * height;
+  frame->packed = malloc( pixels * channels );
+  if( frame->packed == NULL )
+  {
+    stbi_image_free( data );
+    frame->error = "malloc fail for frame data";
+    return;
+  }
+  unsigned char *p = frame->packed;
+  if( channels == 1 )
+  {
+    for( i=0; i<pixels; i++ )
+    {
+      *p++ = source[i * n];
+    }
+  }
+  else if( n >= 3 )
+  {
+    for( i=0; i<pixels; i++ )
+    {
+      *p++ = source[i * n];
+      *p++ = source[( i * n ) + 1];
+      *p++ = source[( i * n ) + 2];
+    }
+  }
+  else
+  {
+    // Grey image in a colour animation
+    for( i=0; i<pixels; i++ )
+    {
+      p[0] = p[1] = p[2] = source[i * n];
+      p += 3;
+    }
+  }
+  stbi_image_free( data );
+
+  if( !write_bml )
+  {
+    return;
+  }
+  // Each value is two hex digits
+  size_t row_length = (size_t)width * channels * 2;
+  frame->text = malloc( 64 + ( height * ( row_length + 16 ) ) );
+  if( frame->text == NULL )
+  {
+    frame->error = "malloc fail for frame text";
+    return;
+  }
+  char *t = frame->text;
+  t += sprintf( t, "  <frame duration=\"%d\">\n", frame->duration );
+  p = frame->packed;
+  for( r=0; r<height; r++ )
+  {
+    memcpy( t, "    <row>", 9 );
+    t += 9;
+    for( i=0; i<width * channels; i++ )
+    {
+      memcpy( t, hex_digits[*p++], 2 );
+      t += 2;
+    }
+    memcpy( t, "</row>\n", 7 );
+    t += 7;
+  }
+  memcpy( t, "  </frame>\n", 11 );
+  t += 11;
+  frame->text_length = t - frame->text;
+}
+
+// ------------------------------------------------------------------------
+// Convert frames until there are none left
+
+static void *convert_thread( void *arg )
+{
+  int i;
+
+  while( ( i = atomic_fetch_add( &next_frame, 1 ) ) < frame_count )
+  {
+    convert_frame( &frames[i] );
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+
+static FILE *open_output( const char *output_name, const char *extension, char **file_name )
+{
+  *file_name = malloc( strlen( output_name ) + strlen( extension ) + 1 );
+  if( *file_name == NULL )
   {
     printf( "ERROR - malloc fail for output_file_name\n" );
-    return EXIT_FAILURE;
+    return NULL;
   }
-  strcpy( output_file_name, argv[1] );
-  strcat( output_file_name, ".bml" );
+  strcpy( *file_name, output_name );
+  strcat( *file_name, extension );
 
-  // Write the output file
-  FILE *output_file = fopen( output_file_name, "w" );
+  FILE *output_file = fopen( *file_name, "wb" );
   if( output_file == NULL )
   {
-    printf( "ERROR - failed to create output file: %s\n", output_file_name );
-    return EXIT_FAILURE;
+    printf( "ERROR - failed to create output file: %s\n", *file_name );
+    return NULL;
   }
+  setvbuf( output_file, NULL, _IOFBF, WRITE_BUFFER_SIZE );
+  return output_file;
+}
+
+// ------------------------------------------------------------------------
+
+static int close_output( FILE *output_file, char *file_name )
+{
+  int ok = ( ferror( output_file ) == 0 );
 
-  // If the colour depth > 3 then set output channels to 3 so as to ignore alpha channels
-  if( n > 3 )
+  if( fclose( output_file ) != 0 )
   {
-    channels = 3;
+    ok = 0;
+  }
+  if( ok )
+  {
+    printf( "Written file: %s\n", file_name );
   }
   else
   {
-    channels = n;
+    printf( "ERROR - failed to write output file: %s\n", file_name );
   }
+  free( file_name );
+  return ok;
+}
+
+// ------------------------------------------------------------------------
 
+static int write_bml_file( const char *output_name )
+{
+  char *output_file_name;
+  FILE *output_file = open_output( output_name, ".bml", &output_file_name );
+  int i;
+
+  if( output_file == NULL )
+  {
+    return 0;
+  }
   fprintf( output_file, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" );
   fprintf( output_file, "<blm width=\"%d\" height=\"%d\" bits=\"8\" channels=\"%d\">\n",
-                          columns, rows, channels );
+                          width, height, channels );
   fprintf( output_file, "  <header>\n" );
   fprintf( output_file, "    <title>Created by img2bml</title>\n" );
   fprintf( output_file, "    <url>https://github.com/john-davies/Blog-code-files/tree/master/LED_Panel</url>\n" );
   fprintf( output_file, "  </header>\n" );
-  fprintf( output_file, "  <frame duration=\"%d\">\n", duration );
+  for( i=0; i<frame_count; i++ )
+  {
+    fwrite( frames[i].text, 1, frames[i].text_length, output_file );
+  }
+  fprintf( output_file, "</blm>\n" );
+  return close_output( output_file, output_file_name );
+}
+
+// ------------------------------------------------------------------------
+
+static unsigned char *put_16( unsigned char *p, unsigned int value )
+{
+  p[0] = value >> 8;
+  p[1] = value;
+  return p + 2;
+}
+
+static unsigned char *put_32( unsigned char *p, unsigned long value )
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+  return p + 4;
+}
 
-  // Loop through rows & columns
-  int r, c;
-  int row_ptr;
-  for( r=0; r<rows; r++ )
+// ------------------------------------------------------------------------
+
+static int write_bbm_file( const char *output_name )
+{
+  char *output_file_name;
+  FILE *output_file = open_output( output_name, ".bbm", &output_file_name );
+  unsigned char header[BBM_HEADER_SIZE], frame_header[2];
+  unsigned long total_duration = 0;
+  size_t frame_size = (size_t)width * height * channels;
+  int i;
+
+  if( output_file == NULL )
+  {
+    return 0;
+  }
+  for( i=0; i<frame_count; i++ )
+  {
+    total_duration += frames[i].duration;
+  }
+  unsigned char *p = put_32( header, BBM_MAGIC );
+  p = put_16( p, height );
+  p = put_16( p, width );
+  p = put_16( p, channels );
+  p = put_16( p, 255 );
+  p = put_32( p, frame_count );
+  p = put_32( p, total_duration );
+  put_32( p, BBM_HEADER_SIZE );
+  fwrite( header, 1, BBM_HEADER_SIZE, output_file );
+  fwrite( "frms", 1, 4, output_file );
+  for( i=0; i<frame_count; i++ )
+  {
+    put_16( frame_header, frames[i].duration );
+    fwrite( frame_header, 1, 2, output_file );
+    fwrite( frames[i].packed, 1, frame_size, output_file );
+  }
+  return close_output( output_file, output_file_name );
+}
+
+// ------------------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+  int duration = 0;
+  int write_bbm = 0;
+  int threads = sysconf( _SC_NPROCESSORS_ONLN );
+  const char *output_name = NULL;
+  int opt, i;
+
+  while( ( opt = getopt( argc, argv, "d:f:o:t:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'd':
+        duration = atoi( optarg );
+        break;
+      case 'f':
+        write_bml = ( strcmp( optarg, "bml" ) == 0 ) || ( strcmp( optarg, "both" ) == 0 );
+        write_bbm = ( strcmp( optarg, "bbm" ) == 0 ) || ( strcmp( optarg, "both" ) == 0 );
+        if( !write_bml && !write_bbm )
+        {
+          printf( "ERROR - output format must be bml, bbm or both\n" );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'o':
+        output_name = optarg;
+        break;
+      case 't':
+        threads = atoi( optarg );
+        break;
+      default:
+        printf( "  Usage is img2bml [ -d duration ] [ -f bml|bbm|both ] [ -o output name ] [ -t threads ]\n" );
+        printf( "                   <file name> [ file name ... ] [ duration ]\n" );
+        return EXIT_FAILURE;
+    }
+  }
+  argc -= optind;
+  argv += optind;
+
+  // Check for image file present
+  if( argc == 0 )
   {
-    row_ptr = r * columns * n;
-    fprintf( output_file, "    <row>" );
-      for( c=0; c<columns; c++ )
+    printf( "ERROR - no image file specified\n" );
+    printf( "  Usage is img2bml [ -d duration ] [ -f bml|bbm|both ] [ -o output name ] [ -t threads ]\n" );
+    printf( "                   <file name> [ file name ... ] [ duration ]\n" );
+    return EXIT_FAILURE;
+  }
+
+  // A number after the file names is the duration
+  if( argc > 1 )
+  {
+    const char *last = argv[argc - 1];
+    for( i=0; isdigit( (unsigned char)last[i] ); i++ )
+      ;
+    if( ( i > 0 ) && ( last[i] == '\0' ) )
+    {
+      if( duration == 0 )
       {
-          fprintf( output_file, "%02x%02x%02x", data[row_ptr], data[row_ptr+1], data[row_ptr+2] );
-          row_ptr += n;
+        duration = atoi( last );
       }
-    fprintf( output_file, "</row>\n" );
+      argc--;
+    }
   }
+  // GIF frames keep their own delays if no duration is given
+  int default_duration = ( duration > 0 ) ? duration : DEFAULT_DURATION;
 
-  fprintf( output_file, "  </frame>\n" );
-  fprintf( output_file, "</blm>\n" );
+  // Find all the frames, checking that they are the same size
+  for( i=0; i<argc; i++ )
+  {
+    int first = frame_count;
+    if( !add_file( argv[i], duration ) )
+    {
+      return EXIT_FAILURE;
+    }
+    for( ; first<frame_count; first++ )
+    {
+      if( frames[first].duration <= 0 )
+      {
+        frames[first].duration = default_duration;
+      }
+      // BBM durations are 16 bit
+      if( frames[first].duration > 65535 )
+      {
+        frames[first].duration = 65535;
+      }
+    }
+  }
+  if( frame_count == 0 )
+  {
+    printf( "ERROR - no frames in the image files\n" );
+    return EXIT_FAILURE;
+  }
+
+  printf( "Image data - " );
+  printf( "Frames: %d, ", frame_count );
+  printf( "Rows: %d, ", height );
+  printf( "Columns: %d, ", width );
+  printf( "Channels: %d\n", channels );
+
+  // Convert the frames in parallel
+  for( i=0; i<256; i++ )
+  {
+    hex_digits[i][0] = "0123456789abcdef"[i >> 4];
+    hex_digits[i][1] = "0123456789abcdef"[i & 0xf];
+  }
+  if( threads > frame_count )
+  {
+    threads = frame_count;
+  }
+  if( threads < 1 )
+  {
+    threads = 1;
+  }
+  pthread_t *thread_ids = malloc( threads * sizeof( pthread_t ) );
+  if( thread_ids == NULL )
+  {
+    printf( "ERROR - malloc fail for threads\n" );
+    return EXIT_FAILURE;
+  }
+  for( i=0; i<threads; i++ )
+  {
+    if( pthread_create( &thread_ids[i], NULL, convert_thread, NULL ) != 0 )
+    {
+      printf( "ERROR - could not start thread\n" );
+      return EXIT_FAILURE;
+    }
+  }
+  for( i=0; i<threads; i++ )
+  {
+    pthread_join( thread_ids[i], NULL );
+  }
+  free( thread_ids );
+  for( i=0; i<frame_count; i++ )
+  {
+    if( frames[i].error != NULL )
+    {
+      printf( "ERROR - frame %d, %s: %s\n", i + 1, frames[i].error,
+              ( frames[i].file_name != NULL ) ? frames[i].file_name : "GIF" );
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Write the output files
+  if( output_name == NULL )
+  {
+    output_name = argv[0];
+  }
+  if( write_bml && !write_bml_file( output_name ) )
+  {
+    return EXIT_FAILURE;
+  }
+  if( write_bbm && !write_bbm_file( output_name ) )
+  {
+    return EXIT_FAILURE;
+  }
 
   // Clean up
-  printf( "Written file: %s\n", output_file_name );
-  fclose( output_file );
-  free( output_file_name );
-  stbi_image_free(data);
+  for( i=0; i<frame_count; i++ )
+  {
+    free( frames[i].packed );
+    free( frames[i].text );
+    if( frames[i].gif_data != NULL )
+    {
+      stbi_image_free( frames[i].gif_data );
+    }
+  }
+  free( frames );
 
   return EXIT_SUCCESS;
 }
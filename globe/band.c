@@ -0,0 +1,136 @@
+// band.c - Reads .bin files in bands of rows
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "band.h"
+
+// ------------------------------------------------------------------------
+
+int band_open( band_t *band, const binfile_t *bin, int band_rows )
+{
+  return band_open_halo( band, bin, band_rows, 0 );
+}
+
+// ------------------------------------------------------------------------
+// Open a band that also holds halo rows either side of it, for working
+// out values that depend on their neighbours
+
+int band_open_halo( band_t *band, const binfile_t *bin, int band_rows, int halo )
+{
+  if( band_rows > bin->height )
+  {
+    band_rows = bin->height;
+  }
+  band->bin = bin;
+  band->width = bin->width;
+  band->height = bin->height;
+  band->band_rows = band_rows;
+  band->first_row = 0;
+  band->rows = 0;
+  band->halo = halo;
+  band->storage = malloc( (size_t)( band_rows + 2 * halo ) * band->width * sizeof( int16_t ) );
+  if( band->storage == NULL )
+  {
+    return -1;
+  }
+  band->data = band->storage + (size_t)halo * band->width;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Read the band starting at first_row, the band is shortened at the end
+// of the file
+
+int band_read( band_t *band, int first_row )
+{
+  int rows = band->band_rows;
+
+  if( ( first_row < 0 ) || ( first_row >= band->height ) )
+  {
+    return -1;
+  }
+  if( first_row + rows > band->height )
+  {
+    rows = band->height - first_row;
+  }
+  // The previous band won't be needed again
+  binfile_done_with( band->bin, band->first_row, band->rows );
+  // Along with any halo rows that are in the file
+  int start = first_row - band->halo;
+  int end = first_row + rows + band->halo;
+  if( start < 0 )
+  {
+    start = 0;
+  }
+  if( end > band->height )
+  {
+    end = band->height;
+  }
+  binfile_read_rows( band->bin, start, end - start,
+                     band->data + (ptrdiff_t)( start - first_row ) * band->width );
+  band->first_row = first_row;
+  band->rows = rows;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Make sure that row y is held, if not then read the band that starts
+// at y, or ends at y when working backwards through the file
+
+int band_fetch( band_t *band, int y, int backwards )
+{
+  if( ( y >= band->first_row ) && ( y < band->first_row + band->rows ) )
+  {
+    return 0;
+  }
+  if( backwards )
+  {
+    y = y - band->band_rows + 1;
+    if( y < 0 )
+    {
+      y = 0;
+    }
+    if( band_read( band, y ) != 0 )
+    {
+      return -1;
+    }
+    // Start reading the next band in
+    int next_row = y - band->band_rows;
+    if( next_row < 0 )
+    {
+      next_row = 0;
+    }
+    binfile_will_need( band->bin, next_row, y - next_row );
+    return 0;
+  }
+  if( band_read( band, y ) != 0 )
+  {
+    return -1;
+  }
+  binfile_will_need( band->bin, y + band->rows, band->band_rows );
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+void band_close( band_t *band )
+{
+  free( band->storage );
+  band->storage = NULL;
+  band->data = NULL;
+}
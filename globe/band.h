@@ -0,0 +1,65 @@
+// band.h - Reads .bin files in bands of rows
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BAND_H
+#define BAND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "binfile.h"
+
+// Default number of rows held in memory at once
+#define BAND_ROWS 256
+
+// A band of consecutive rows from a .bin file converted to host order
+typedef struct
+{
+  const binfile_t *bin;
+  int width;        // values per row
+  int height;       // rows in the file
+  int band_rows;    // maximum rows held
+  int first_row;    // file row held in data[0]
+  int rows;         // rows currently held
+  int halo;         // extra rows held either side of the band
+  int16_t *data;    // first row of the band
+  int16_t *storage; // ( band_rows + 2 * halo ) * width values
+} band_t;
+
+int band_open( band_t *band, const binfile_t *bin, int band_rows );
+int band_open_halo( band_t *band, const binfile_t *bin, int band_rows, int halo );
+int band_read( band_t *band, int first_row );
+int band_fetch( band_t *band, int y, int backwards );
+void band_close( band_t *band );
+
+// Values are stored row by row so that walking along a row, which all
+// of the tools do in their inner loops, steps through memory in order.
+// A band with band_rows equal to the file height holds the whole grid.
+// Rows up to halo either side of the band can also be used, as long as
+// they are in the file
+
+// Pointer to the start of a row, the row must be in the current band
+static inline int16_t *band_row( band_t *band, int y )
+{
+  return band->data + (ptrdiff_t)( y - band->first_row ) * band->width;
+}
+
+// A single value, the row must be in the current band
+static inline int16_t band_get( const band_t *band, int x, int y )
+{
+  return band->data[(ptrdiff_t)( y - band->first_row ) * band->width + x];
+}
+
+#endif
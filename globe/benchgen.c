@@ -0,0 +1,369 @@
+// benchgen.c - Makes synthetic height and mask files for benchmarking
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "binfile.h"
+
+// Cells across the coarsest octave of noise, each octave has twice as
+// many as the one before
+#define BASE_CELLS 6
+#define OCTAVES 10
+// Heights are scaled to roughly the range of the Earth2014 files
+#define LAND_SCALE 7000.0
+#define SEA_SCALE 9000.0
+// Moves the noise so that about two thirds of the surface is sea
+#define SEA_BIAS 0.15
+// Land nearer the poles than this is ice covered
+#define ICE_LATITUDE 65.0
+#define DEFAULT_SEED 1
+// Rows in each TIFF strip
+#define TIFF_STRIP_ROWS 16
+
+// Mask classes, see colour.c
+#define MASK_LAND 0
+#define MASK_OCEAN 2
+#define MASK_ICE 5
+
+// ------------------------------------------------------------------------
+// A repeatable value between -1 and 1 for each point of the lattice
+
+static double lattice( uint32_t seed, int octave, int x, int y )
+{
+  uint32_t h = seed * 0x9e3779b9u;
+
+  h ^= (uint32_t)octave * 0x85ebca6bu;
+  h ^= (uint32_t)x * 0xc2b2ae35u;
+  h = ( h ^ ( h >> 16 ) ) * 0x7feb352du;
+  h ^= (uint32_t)y * 0x27d4eb2fu;
+  h = ( h ^ ( h >> 15 ) ) * 0x846ca68bu;
+  h ^= h >> 16;
+  return h / 2147483647.5 - 1.0;
+}
+
+// ------------------------------------------------------------------------
+// Fractal value noise at u, v, from 0 to 1 across the grid.  Each octave
+// wraps round in longitude so there is no seam
+
+static double noise( uint32_t seed, double u, double v )
+{
+  double total = 0.0;
+  double amplitude = 1.0;
+  int cells = BASE_CELLS;
+
+  for( int octave = 0; octave < OCTAVES; octave++ )
+  {
+    double fx = u * cells;
+    double fy = v * cells / 2;
+    int x0 = (int)fx;
+    int y0 = (int)fy;
+    double tx = fx - x0;
+    double ty = fy - y0;
+    int x1 = ( x0 + 1 ) % cells;
+    // Smooth the joins between cells
+    tx = tx * tx * ( 3.0 - 2.0 * tx );
+    ty = ty * ty * ( 3.0 - 2.0 * ty );
+    double south = lattice( seed, octave, x0, y0 ) + ( lattice( seed, octave, x1, y0 ) - lattice( seed, octave, x0, y0 ) ) * tx;
+    double north = lattice( seed, octave, x0, y0 + 1 ) + ( lattice( seed, octave, x1, y0 + 1 ) - lattice( seed, octave, x0, y0 + 1 ) ) * tx;
+    total += amplitude * ( south + ( north - south ) * ty );
+    amplitude *= 0.5;
+    cells *= 2;
+  }
+  return total;
+}
+
+// ------------------------------------------------------------------------
+// Heights and mask values for one row
+
+static void make_row( uint32_t seed, int xsize, int ysize, int y, int16_t *heights, int16_t *mask )
+{
+  double v = ( y + 0.5 ) / ysize;
+  double latitude = v * 180.0 - 90.0;
+
+  for( int x = 0; x < xsize; x++ )
+  {
+    double n = noise( seed, (double)x / xsize, v ) - SEA_BIAS;
+    if( n > 0.0 )
+    {
+      heights[x] = lrint( n * n * LAND_SCALE );
+      mask[x] = ( fabs( latitude ) > ICE_LATITUDE ) ? MASK_ICE : MASK_LAND;
+    }
+    else
+    {
+      heights[x] = lrint( -sqrt( -n ) * SEA_SCALE );
+      mask[x] = MASK_OCEAN;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+// Little endian TIFF values
+
+static void put_tiff16( unsigned char *dest, unsigned int value )
+{
+  dest[0] = value & 0xff;
+  dest[1] = value >> 8;
+}
+
+static void put_tiff32( unsigned char *dest, uint32_t value )
+{
+  for( int i = 0; i < 4; i++ )
+  {
+    dest[i] = ( value >> ( 8 * i ) ) & 0xff;
+  }
+}
+
+static void put_tiff_entry( unsigned char *dest, int tag, int type, uint32_t count, uint32_t value )
+{
+  put_tiff16( dest, tag );
+  put_tiff16( dest + 2, type );
+  put_tiff32( dest + 4, count );
+  // Short values go in the first two bytes of the value field
+  if( ( type == 3 ) && ( count == 1 ) )
+  {
+    put_tiff32( dest + 8, 0 );
+    put_tiff16( dest + 8, value );
+  }
+  else
+  {
+    put_tiff32( dest + 8, value );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Write the start of an uncompressed strip TIFF of signed 16 bit values,
+// the rows follow it, top row first.  The strip tables go after the
+// header and directory so the rows can be written as they are made
+
+static int write_tiff_header( FILE *file, int xsize, int ysize )
+{
+  const int entries = 11;
+  uint32_t strips = ( ysize + TIFF_STRIP_ROWS - 1 ) / TIFF_STRIP_ROWS;
+  uint32_t directory = 8;
+  uint32_t offsets = directory + 2 + entries * 12 + 4;
+  uint32_t counts = offsets + 4 * strips;
+  uint32_t data = counts + 4 * strips;
+  uint32_t strip_size = (uint32_t)xsize * TIFF_STRIP_ROWS * 2;
+  uint32_t image_size = (uint32_t)xsize * ysize * 2;
+  size_t size = data;
+  unsigned char *header = calloc( size, 1 );
+
+  if( header == NULL )
+  {
+    return -1;
+  }
+  memcpy( header, "II", 2 );
+  put_tiff16( header + 2, 42 );
+  put_tiff32( header + 4, directory );
+  unsigned char *p = header + directory;
+  put_tiff16( p, entries );
+  p += 2;
+  // Tags must be in order
+  put_tiff_entry( p, 256, 4, 1, xsize ); p += 12;                          // image width
+  put_tiff_entry( p, 257, 4, 1, ysize ); p += 12;                          // image length
+  put_tiff_entry( p, 258, 3, 1, 16 ); p += 12;                             // bits per sample
+  put_tiff_entry( p, 259, 3, 1, 1 ); p += 12;                              // no compression
+  put_tiff_entry( p, 262, 3, 1, 1 ); p += 12;                              // black is zero
+  put_tiff_entry( p, 273, 4, strips, strips > 1 ? offsets : data ); p += 12; // strip offsets
+  put_tiff_entry( p, 277, 3, 1, 1 ); p += 12;                              // samples per pixel
+  put_tiff_entry( p, 278, 4, 1, TIFF_STRIP_ROWS ); p += 12;                // rows per strip
+  put_tiff_entry( p, 279, 4, strips, strips > 1 ? counts : image_size ); p += 12; // strip sizes
+  put_tiff_entry( p, 284, 3, 1, 1 ); p += 12;                              // one plane
+  put_tiff_entry( p, 339, 3, 1, 2 ); p += 12;                              // signed
+  put_tiff32( p, 0 );
+  for( uint32_t i = 0; i < strips; i++ )
+  {
+    uint32_t rows = ysize - i * TIFF_STRIP_ROWS;
+    if( rows > TIFF_STRIP_ROWS )
+    {
+      rows = TIFF_STRIP_ROWS;
+    }
+    put_tiff32( header + offsets + 4 * i, data + i * strip_size );
+    put_tiff32( header + counts + 4 * i, rows * xsize * 2 );
+  }
+  int status = ( fwrite( header, size, 1, file ) == 1 ) ? 0 : -1;
+  free( header );
+  return status;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: benchgen [options] <xsize> <height file> <mask file>\n" );
+  printf( "  ( the files are ysize = xsize / 2 rows of made up terrain, the same\n" );
+  printf( "    every time for the same size and seed )\n" );
+  printf( "  Options:\n" );
+  printf( "    -s seed           noise seed, default %d\n", DEFAULT_SEED );
+  printf( "    -H                write a header with the size and range of the data\n" );
+  printf( "    -T file           also write the heights as a TIFF file for tif2bin\n" );
+}
+
+// ------------------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+  uint32_t seed = DEFAULT_SEED;
+  int header = 0;
+  char *tiff_file_name = NULL;
+  int opt;
+
+  printf( "benchgen, v0.1\n" );
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+s:HT:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 's':
+        seed = strtoul( optarg, NULL, 0 );
+        break;
+      case 'H':
+        header = 1;
+        break;
+      case 'T':
+        tiff_file_name = optarg;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that argv[1] is the first positional
+  // argument
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( argc != 4 )
+  {
+    usage();
+    return EXIT_FAILURE;
+  }
+  int xsize = atoi( argv[1] );
+  if( ( xsize < 2 ) || ( xsize % 2 != 0 ) )
+  {
+    printf( "ERROR: invalid X size: %s\n", argv[1] );
+    return EXIT_FAILURE;
+  }
+  int ysize = xsize / 2;
+
+  FILE *height_file = fopen( argv[2], "wb" );
+  if( height_file == NULL )
+  {
+    printf( "ERROR: could not open height file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+  FILE *mask_file = fopen( argv[3], "wb" );
+  if( mask_file == NULL )
+  {
+    printf( "ERROR: could not open mask file: %s\n", argv[3] );
+    return EXIT_FAILURE;
+  }
+  FILE *tiff_file = NULL;
+  if( tiff_file_name != NULL )
+  {
+    tiff_file = fopen( tiff_file_name, "wb" );
+    if( ( tiff_file == NULL ) || ( write_tiff_header( tiff_file, xsize, ysize ) != 0 ) )
+    {
+      printf( "ERROR: could not write TIFF file: %s\n", tiff_file_name );
+      return EXIT_FAILURE;
+    }
+  }
+  int16_t *heights = malloc( (size_t)xsize * sizeof( int16_t ) );
+  int16_t *mask = malloc( (size_t)xsize * sizeof( int16_t ) );
+  unsigned char *tiff_row = malloc( (size_t)xsize * 2 );
+  if( ( heights == NULL ) || ( mask == NULL ) || ( tiff_row == NULL ) )
+  {
+    printf( "ERROR: could not allocate row buffers\n" );
+    return EXIT_FAILURE;
+  }
+
+  // The range isn't known until every row has been made so write a
+  // header without it and fill it in at the end
+  if( header )
+  {
+    binfile_write_header( height_file, xsize, ysize, 0, 0 );
+    binfile_write_header( mask_file, xsize, ysize, 0, 0 );
+  }
+  printf( "Making %d x %d grid, seed %u ...\n", xsize, ysize, seed );
+  int min = INT16_MAX;
+  int max = INT16_MIN;
+  for( int y = 0; y < ysize; y++ )
+  {
+    make_row( seed, xsize, ysize, y, heights, mask );
+    for( int x = 0; x < xsize; x++ )
+    {
+      if( heights[x] < min )
+      {
+        min = heights[x];
+      }
+      if( heights[x] > max )
+      {
+        max = heights[x];
+      }
+    }
+    if( ( binfile_write_values( height_file, heights, xsize ) != 0 ) ||
+        ( binfile_write_values( mask_file, mask, xsize ) != 0 ) )
+    {
+      printf( "ERROR: failed to write output files\n" );
+      return EXIT_FAILURE;
+    }
+  }
+  // TIFF rows go north first, the other way up to .bin files
+  if( tiff_file != NULL )
+  {
+    for( int y = ysize - 1; y >= 0; y-- )
+    {
+      make_row( seed, xsize, ysize, y, heights, mask );
+      for( int x = 0; x < xsize; x++ )
+      {
+        put_tiff16( tiff_row + 2 * x, (uint16_t)heights[x] );
+      }
+      if( fwrite( tiff_row, (size_t)xsize * 2, 1, tiff_file ) != 1 )
+      {
+        printf( "ERROR: failed to write TIFF file: %s\n", tiff_file_name );
+        return EXIT_FAILURE;
+      }
+    }
+    if( fclose( tiff_file ) != 0 )
+    {
+      printf( "ERROR: failed to write TIFF file: %s\n", tiff_file_name );
+      return EXIT_FAILURE;
+    }
+  }
+  if( header )
+  {
+    rewind( height_file );
+    rewind( mask_file );
+    binfile_write_header( height_file, xsize, ysize, min, max );
+    binfile_write_header( mask_file, xsize, ysize, MASK_LAND, MASK_ICE );
+  }
+  printf( "  min: %d, max: %d\n", min, max );
+  free( tiff_row );
+  free( mask );
+  free( heights );
+  if( ( fclose( height_file ) != 0 ) || ( fclose( mask_file ) != 0 ) )
+  {
+    printf( "ERROR: failed to write output files\n" );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
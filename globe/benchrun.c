@@ -0,0 +1,428 @@
+// benchrun.c - Runs the globe tools on synthetic data and reports how
+//              long they took as JSON
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#define MAX_SIZES 16
+#define MAX_ARGS 16
+#define MAX_OUTPUTS 4
+#define NAME_SIZE 1024
+#define DEFAULT_DIR "bench_data"
+#define DEFAULT_GRADIENTS "gradients"
+#define PLANET_RADIUS "6371"
+
+// How throughput is counted
+typedef enum
+{
+  UNIT_MPIXEL,
+  UNIT_MVERTEX
+} unit_t;
+
+// One run of a tool.  In args and outputs %H is the height file, %M the
+// mask file, %T the TIFF file, %L and %S the terrain and bathymetry LUTs,
+// %X the X size and %D the data directory
+typedef struct
+{
+  const char *name;
+  const char *tool;
+  const char *args[MAX_ARGS];
+  const char *outputs[MAX_OUTPUTS];
+  unit_t unit;
+} bench_case_t;
+
+static const bench_case_t cases[] =
+{
+  { "tif2bin", "tif2bin", { "-H", "%T", "%D/tif2bin.bin" }, { "%D/tif2bin.bin" }, UNIT_MPIXEL },
+  { "rescale_nearest", "rescale", { "%H", "2", "%D/rescale_nearest.bin" }, { "%D/rescale_nearest.bin" }, UNIT_MPIXEL },
+  { "rescale_lanczos", "rescale", { "-f", "lanczos", "%H", "2", "%D/rescale_lanczos.bin" }, { "%D/rescale_lanczos.bin" }, UNIT_MPIXEL },
+  { "makeimage", "makeimage", { "%H", "%M", "%L", "%S", "%X" }, { "%H.png" }, UNIT_MPIXEL },
+  { "makeglobe_binary", "makeglobe", { "-f", "binary", "%H", "%M", "%L", "%S", "%X", PLANET_RADIUS }, { "%H.ply" }, UNIT_MVERTEX },
+  { "makeglobe_compact", "makeglobe", { "-f", "compact", "%H", "%M", "%L", "%S", "%X", PLANET_RADIUS }, { "%H.gmsh" }, UNIT_MVERTEX },
+};
+#define CASES ( (int)( sizeof( cases ) / sizeof( cases[0] ) ) )
+
+// Everything needed to fill in the arguments
+typedef struct
+{
+  const char *dir;
+  const char *gradients;
+  char height[NAME_SIZE];
+  char mask[NAME_SIZE];
+  char tiff[NAME_SIZE];
+  char xsize[16];
+} files_t;
+
+// What was measured for one run
+typedef struct
+{
+  int status;           // exit status, -1 if it couldn't be run
+  double wall;
+  double user;
+  double system;
+  long max_rss;         // kB
+  long long bytes;
+} result_t;
+
+// ------------------------------------------------------------------------
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double seconds( struct timeval tv )
+{
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// ------------------------------------------------------------------------
+// Replace the %X style names in an argument
+
+static void expand( const char *in, const files_t *files, char *out )
+{
+  size_t length = 0;
+
+  out[0] = '\0';
+  while( *in != '\0' )
+  {
+    const char *value = NULL;
+    char lut[NAME_SIZE];
+    if( in[0] == '%' )
+    {
+      switch( in[1] )
+      {
+        case 'H': value = files->height; break;
+        case 'M': value = files->mask; break;
+        case 'T': value = files->tiff; break;
+        case 'X': value = files->xsize; break;
+        case 'D': value = files->dir; break;
+        case 'L':
+        case 'S':
+          snprintf( lut, NAME_SIZE, "%s/%s.bin", files->gradients, in[1] == 'L' ? "land" : "sea" );
+          value = lut;
+          break;
+      }
+    }
+    if( value != NULL )
+    {
+      length += snprintf( out + length, NAME_SIZE - length, "%s", value );
+      in += 2;
+    }
+    else if( length < NAME_SIZE - 1 )
+    {
+      out[length++] = *in++;
+      out[length] = '\0';
+    }
+    if( length >= NAME_SIZE - 1 )
+    {
+      break;
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+// Run a program with its output going to a log file, returns the exit
+// status or -1 if it couldn't be run.  wait4 gives the resources used by
+// just that process
+
+static int run( char *const argv[], const char *log_name, result_t *result )
+{
+  struct rusage usage;
+  int status;
+
+  double start = now();
+  pid_t pid = fork();
+  if( pid < 0 )
+  {
+    return -1;
+  }
+  if( pid == 0 )
+  {
+    int fd = open( log_name, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( fd >= 0 )
+    {
+      dup2( fd, STDOUT_FILENO );
+      dup2( fd, STDERR_FILENO );
+      close( fd );
+    }
+    execv( argv[0], argv );
+    _exit( 127 );
+  }
+  if( wait4( pid, &status, 0, &usage ) < 0 )
+  {
+    return -1;
+  }
+  result->wall = now() - start;
+  result->user = seconds( usage.ru_utime );
+  result->system = seconds( usage.ru_stime );
+  result->max_rss = usage.ru_maxrss;
+  if( !WIFEXITED( status ) )
+  {
+    return -1;
+  }
+  return WEXITSTATUS( status );
+}
+
+// ------------------------------------------------------------------------
+// Run one case, the outputs are deleted afterwards unless keep is set
+
+static void run_case( const bench_case_t *c, const files_t *files, int keep, result_t *result )
+{
+  char args[MAX_ARGS + 2][NAME_SIZE];
+  char *argv[MAX_ARGS + 2];
+  char log_name[NAME_SIZE];
+  int n = 0;
+
+  snprintf( args[n], NAME_SIZE, "./%s", c->tool );
+  argv[n] = args[n];
+  n++;
+  for( int i = 0; ( i < MAX_ARGS ) && ( c->args[i] != NULL ); i++ )
+  {
+    expand( c->args[i], files, args[n] );
+    argv[n] = args[n];
+    n++;
+  }
+  argv[n] = NULL;
+  snprintf( log_name, NAME_SIZE, "%s/%s_%s.log", files->dir, c->name, files->xsize );
+
+  memset( result, 0, sizeof( result_t ) );
+  result->status = run( argv, log_name, result );
+  for( int i = 0; ( i < MAX_OUTPUTS ) && ( c->outputs[i] != NULL ); i++ )
+  {
+    char output[NAME_SIZE];
+    struct stat st;
+    expand( c->outputs[i], files, output );
+    if( stat( output, &st ) == 0 )
+    {
+      result->bytes += st.st_size;
+    }
+    if( !keep )
+    {
+      unlink( output );
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+
+static void put_result( FILE *file, int first, const char *name, const char *tool, int xsize,
+                        unit_t unit, const result_t *result )
+{
+  int ysize = xsize / 2;
+  double millions = (double)xsize * ysize / 1e6;
+
+  fprintf( file, "%s    {\n", first ? "" : ",\n" );
+  fprintf( file, "      \"name\": \"%s\",\n", name );
+  fprintf( file, "      \"tool\": \"%s\",\n", tool );
+  fprintf( file, "      \"xsize\": %d,\n", xsize );
+  fprintf( file, "      \"ysize\": %d,\n", ysize );
+  if( result == NULL )
+  {
+    fprintf( file, "      \"skipped\": true\n" );
+    fprintf( file, "    }" );
+    return;
+  }
+  fprintf( file, "      \"status\": %d,\n", result->status );
+  fprintf( file, "      \"wall_seconds\": %.4f,\n", result->wall );
+  fprintf( file, "      \"user_seconds\": %.4f,\n", result->user );
+  fprintf( file, "      \"system_seconds\": %.4f,\n", result->system );
+  fprintf( file, "      \"max_rss_kb\": %ld,\n", result->max_rss );
+  fprintf( file, "      \"bytes_written\": %lld,\n", result->bytes );
+  fprintf( file, "      \"unit\": \"%s\",\n", ( unit == UNIT_MVERTEX ) ? "Mvertex/s" : "Mpixel/s" );
+  fprintf( file, "      \"throughput\": %.3f\n", ( result->wall > 0.0 ) ? millions / result->wall : 0.0 );
+  fprintf( file, "    }" );
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: benchrun [options] <xsize> [xsize ...]\n" );
+  printf( "  ( makes synthetic data of each size with benchgen, times each tool\n" );
+  printf( "    on it and writes a JSON report.  Run it in the globe directory )\n" );
+  printf( "  Options:\n" );
+  printf( "    -d directory      where data, logs and outputs go, default %s\n", DEFAULT_DIR );
+  printf( "    -g directory      where the land.bin and sea.bin LUTs are, default %s\n", DEFAULT_GRADIENTS );
+  printf( "    -o file           JSON report, default is standard output\n" );
+  printf( "    -k                keep the outputs of each tool\n" );
+}
+
+// ------------------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+  files_t files;
+  const char *report_name = NULL;
+  int keep = 0;
+  int sizes[MAX_SIZES];
+  int size_count;
+  int opt;
+
+  files.dir = DEFAULT_DIR;
+  files.gradients = DEFAULT_GRADIENTS;
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+d:g:o:k" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'd':
+        files.dir = optarg;
+        break;
+      case 'g':
+        files.gradients = optarg;
+        break;
+      case 'o':
+        report_name = optarg;
+        break;
+      case 'k':
+        keep = 1;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that argv[1] is the first positional
+  // argument
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( ( argc < 2 ) || ( argc - 1 > MAX_SIZES ) )
+  {
+    usage();
+    return EXIT_FAILURE;
+  }
+  size_count = argc - 1;
+  for( int i = 0; i < size_count; i++ )
+  {
+    sizes[i] = atoi( argv[i + 1] );
+    if( ( sizes[i] < 2 ) || ( sizes[i] % 2 != 0 ) )
+    {
+      printf( "ERROR: invalid X size: %s\n", argv[i + 1] );
+      return EXIT_FAILURE;
+    }
+  }
+  if( ( mkdir( files.dir, 0755 ) != 0 ) && ( access( files.dir, W_OK ) != 0 ) )
+  {
+    printf( "ERROR: could not make directory: %s\n", files.dir );
+    return EXIT_FAILURE;
+  }
+  if( access( "./benchgen", X_OK ) != 0 )
+  {
+    printf( "ERROR: benchgen not found in the current directory\n" );
+    return EXIT_FAILURE;
+  }
+  FILE *report = stdout;
+  if( report_name != NULL )
+  {
+    report = fopen( report_name, "w" );
+    if( report == NULL )
+    {
+      printf( "ERROR: could not open report file: %s\n", report_name );
+      return EXIT_FAILURE;
+    }
+  }
+  // Progress goes to stderr when the report is on stdout
+  FILE *progress = ( report == stdout ) ? stderr : stdout;
+
+  struct utsname host;
+  time_t t = time( NULL );
+  char date[32];
+  uname( &host );
+  strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%SZ", gmtime( &t ) );
+  fprintf( report, "{\n" );
+  fprintf( report, "  \"version\": 1,\n" );
+  fprintf( report, "  \"date\": \"%s\",\n", date );
+  fprintf( report, "  \"host\": \"%s\",\n", host.nodename );
+  fprintf( report, "  \"machine\": \"%s\",\n", host.machine );
+  fprintf( report, "  \"cpus\": %ld,\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+  fprintf( report, "  \"results\": [\n" );
+
+  int first = 1;
+  int failed = 0;
+  for( int s = 0; s < size_count; s++ )
+  {
+    char gen_log[NAME_SIZE];
+    snprintf( files.xsize, sizeof( files.xsize ), "%d", sizes[s] );
+    snprintf( files.height, NAME_SIZE, "%s/height_%d.bin", files.dir, sizes[s] );
+    snprintf( files.mask, NAME_SIZE, "%s/mask_%d.bin", files.dir, sizes[s] );
+    snprintf( files.tiff, NAME_SIZE, "%s/height_%d.tif", files.dir, sizes[s] );
+    snprintf( gen_log, NAME_SIZE, "%s/benchgen_%d.log", files.dir, sizes[s] );
+
+    // The data is the same every time so it is only made once
+    result_t result;
+    if( ( access( files.height, R_OK ) != 0 ) || ( access( files.mask, R_OK ) != 0 ) ||
+        ( access( files.tiff, R_OK ) != 0 ) )
+    {
+      fprintf( progress, "Making %d x %d data ...\n", sizes[s], sizes[s] / 2 );
+      char *gen_argv[] = { "./benchgen", "-H", "-T", files.tiff, files.xsize, files.height, files.mask, NULL };
+      if( run( gen_argv, gen_log, &result ) != 0 )
+      {
+        printf( "ERROR: benchgen failed, see %s\n", gen_log );
+        return EXIT_FAILURE;
+      }
+    }
+    for( int i = 0; i < CASES; i++ )
+    {
+      char tool[NAME_SIZE];
+      snprintf( tool, NAME_SIZE, "./%s", cases[i].tool );
+      if( access( tool, X_OK ) != 0 )
+      {
+        fprintf( progress, "  %s %d: skipped, %s not built\n", cases[i].name, sizes[s], cases[i].tool );
+        put_result( report, first, cases[i].name, cases[i].tool, sizes[s], cases[i].unit, NULL );
+      }
+      else
+      {
+        run_case( &cases[i], &files, keep, &result );
+        fprintf( progress, "  %s %d: %.2f s, %ld kB\n", cases[i].name, sizes[s], result.wall, result.max_rss );
+        if( result.status != 0 )
+        {
+          fprintf( progress, "    failed with status %d\n", result.status );
+          failed = 1;
+        }
+        put_result( report, first, cases[i].name, cases[i].tool, sizes[s], cases[i].unit, &result );
+      }
+      first = 0;
+    }
+  }
+  fprintf( report, "\n  ]\n}\n" );
+  if( ( report != stdout ) && ( fclose( report ) != 0 ) )
+  {
+    printf( "ERROR: failed to write report file: %s\n", report_name );
+    return EXIT_FAILURE;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,340 @@
+// binfile.c - Memory mapped access to .bin height and mask files
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "binfile.h"
+
+// Size of the buffer used when writing values
+#define WRITE_BUFFER_SIZE ( 64 * 1024 )
+
+// ------------------------------------------------------------------------
+// Big endian helpers
+
+static uint32_t get_uint32( const unsigned char *p )
+{
+  return ( (uint32_t)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+static int16_t get_int16( const unsigned char *p )
+{
+  return (int16_t)( ( p[0] << 8 ) | p[1] );
+}
+
+static void put_uint32( unsigned char *p, uint32_t value )
+{
+  p[0] = ( value >> 24 ) & 0xff;
+  p[1] = ( value >> 16 ) & 0xff;
+  p[2] = ( value >> 8 ) & 0xff;
+  p[3] = value & 0xff;
+}
+
+static void put_int16( unsigned char *p, int16_t value )
+{
+  p[0] = ( (uint16_t)value >> 8 ) & 0xff;
+  p[1] = value & 0xff;
+}
+
+// ------------------------------------------------------------------------
+// Apply madvise to the pages covering a range of rows
+
+static void advise_rows( const binfile_t *bin, int first_row, int rows, int advice )
+{
+  size_t page = sysconf( _SC_PAGESIZE );
+  size_t start = ( bin->samples - bin->map ) + (size_t)first_row * bin->width * 2;
+  size_t end = start + (size_t)rows * bin->width * 2;
+
+  if( end > bin->map_size )
+  {
+    end = bin->map_size;
+  }
+  start -= start % page;
+  if( end > start )
+  {
+    madvise( (void *)( bin->map + start ), end - start, advice );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Map a file.  If the file has a header then its dimensions are used,
+// otherwise it is taken to be width * height values and must be at
+// least that long
+
+int binfile_open( binfile_t *bin, const char *file_name, int width, int height )
+{
+  struct stat st;
+
+  memset( bin, 0, sizeof( *bin ) );
+  bin->fd = open( file_name, O_RDONLY );
+  if( bin->fd < 0 )
+  {
+    return BINFILE_ERR_OPEN;
+  }
+  if( fstat( bin->fd, &st ) != 0 )
+  {
+    close( bin->fd );
+    return BINFILE_ERR_OPEN;
+  }
+  if( st.st_size == 0 )
+  {
+    // Nothing to map
+    close( bin->fd );
+    return BINFILE_ERR_SHORT;
+  }
+  bin->map_size = st.st_size;
+  bin->map = mmap( NULL, bin->map_size, PROT_READ, MAP_SHARED, bin->fd, 0 );
+  if( bin->map == MAP_FAILED )
+  {
+    bin->map = NULL;
+    close( bin->fd );
+    return BINFILE_ERR_OPEN;
+  }
+  // The files are mostly read from start to end
+  madvise( (void *)bin->map, bin->map_size, MADV_SEQUENTIAL );
+
+  // Check for a header, version 1 is the same without the sample type
+  // and byte order
+  bin->samples = bin->map;
+  if( ( bin->map_size >= BINFILE_HEADER_SIZE ) &&
+      ( memcmp( bin->map, BINFILE_MAGIC, 4 ) == 0 ) &&
+      ( ( bin->map[4] == 1 ) || ( bin->map[4] == BINFILE_VERSION ) ) )
+  {
+    uint32_t header_width = get_uint32( bin->map + 8 );
+    uint32_t header_height = get_uint32( bin->map + 12 );
+    if( ( header_width > 0 ) && ( header_height > 0 ) && ( header_width <= INT32_MAX ) &&
+        ( header_height <= INT32_MAX ) &&
+        ( bin->map_size == BINFILE_HEADER_SIZE + (size_t)header_width * header_height * 2 ) )
+    {
+      if( ( bin->map[4] == BINFILE_VERSION ) && ( bin->map[6] != BINFILE_SAMPLE_INT16 ) )
+      {
+        binfile_close( bin );
+        return BINFILE_ERR_FORMAT;
+      }
+      bin->has_header = 1;
+      bin->little_endian = ( bin->map[4] == BINFILE_VERSION ) && ( bin->map[5] & BINFILE_FLAG_LITTLE_ENDIAN );
+      bin->samples = bin->map + BINFILE_HEADER_SIZE;
+      bin->width = header_width;
+      bin->height = header_height;
+      if( bin->map[5] & BINFILE_FLAG_RANGE )
+      {
+        bin->has_range = 1;
+        bin->min = get_int16( bin->map + 16 );
+        bin->max = get_int16( bin->map + 18 );
+      }
+      return BINFILE_OK;
+    }
+  }
+  // No header so the size must be given
+  bin->width = width;
+  bin->height = height;
+  if( ( width < 1 ) || ( height < 1 ) )
+  {
+    binfile_close( bin );
+    return BINFILE_ERR_SIZE;
+  }
+  if( bin->map_size < (size_t)width * height * 2 )
+  {
+    binfile_close( bin );
+    return BINFILE_ERR_SHORT;
+  }
+  return BINFILE_OK;
+}
+
+// ------------------------------------------------------------------------
+
+const char *binfile_error( int code )
+{
+  switch( code )
+  {
+    case BINFILE_OK:
+      return "no error";
+    case BINFILE_ERR_OPEN:
+      return "could not open file";
+    case BINFILE_ERR_SHORT:
+      return "file is too short";
+    case BINFILE_ERR_SIZE:
+      return "invalid size";
+    case BINFILE_ERR_FORMAT:
+      return "unsupported sample type";
+    default:
+      return "unknown error";
+  }
+}
+
+// ------------------------------------------------------------------------
+// Copy rows into dest converting them to host order
+
+void binfile_read_rows( const binfile_t *bin, int first_row, int rows, int16_t *dest )
+{
+  const unsigned char *p = bin->samples + (size_t)first_row * bin->width * 2;
+  size_t count = (size_t)rows * bin->width;
+
+  if( bin->little_endian )
+  {
+    for( size_t i = 0; i < count; i++ )
+    {
+      dest[i] = (int16_t)( p[2*i] | ( p[2*i+1] << 8 ) );
+    }
+    return;
+  }
+  for( size_t i = 0; i < count; i++ )
+  {
+    dest[i] = (int16_t)( ( p[2*i] << 8 ) | p[2*i+1] );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Hints for the kernel, rows that will be needed soon can be read ahead
+// and rows that are finished with can be dropped from the mapping
+
+void binfile_will_need( const binfile_t *bin, int first_row, int rows )
+{
+  if( first_row + rows > bin->height )
+  {
+    rows = bin->height - first_row;
+  }
+  if( rows > 0 )
+  {
+    advise_rows( bin, first_row, rows, MADV_WILLNEED );
+  }
+}
+
+void binfile_done_with( const binfile_t *bin, int first_row, int rows )
+{
+  if( rows > 0 )
+  {
+    advise_rows( bin, first_row, rows, MADV_DONTNEED );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Get the minimum and maximum values, from the header if possible or
+// by scanning the file
+
+void binfile_min_max( binfile_t *bin, int *min, int *max )
+{
+  if( !bin->has_range )
+  {
+    size_t count = (size_t)bin->width * bin->height;
+    int16_t low = INT16_MAX;
+    int16_t high = INT16_MIN;
+    for( size_t i = 0; i < count; i++ )
+    {
+      const unsigned char *p = bin->samples + 2 * i;
+      int16_t value = bin->little_endian ? (int16_t)( p[0] | ( p[1] << 8 ) ) : get_int16( p );
+      if( value < low )
+      {
+        low = value;
+      }
+      if( value > high )
+      {
+        high = value;
+      }
+    }
+    bin->min = low;
+    bin->max = high;
+    bin->has_range = 1;
+  }
+  *min = bin->min;
+  *max = bin->max;
+}
+
+// ------------------------------------------------------------------------
+
+void binfile_close( binfile_t *bin )
+{
+  if( bin->map != NULL )
+  {
+    munmap( (void *)bin->map, bin->map_size );
+    close( bin->fd );
+  }
+  bin->map = NULL;
+  bin->samples = NULL;
+}
+
+// ------------------------------------------------------------------------
+// Fill in a header, for files that are written in place.  The values
+// are always written big endian
+
+void binfile_make_header( unsigned char *header, int width, int height, int min, int max )
+{
+  memset( header, 0, BINFILE_HEADER_SIZE );
+  memcpy( header, BINFILE_MAGIC, 4 );
+  header[4] = BINFILE_VERSION;
+  header[5] = BINFILE_FLAG_RANGE;
+  header[6] = BINFILE_SAMPLE_INT16;
+  put_uint32( header + 8, width );
+  put_uint32( header + 12, height );
+  put_int16( header + 16, min );
+  put_int16( header + 18, max );
+}
+
+// ------------------------------------------------------------------------
+// Write a header, the values must follow
+
+int binfile_write_header( FILE *file, int width, int height, int min, int max )
+{
+  unsigned char header[BINFILE_HEADER_SIZE];
+
+  binfile_make_header( header, width, height, min, max );
+  if( fwrite( header, sizeof( header ), 1, file ) != 1 )
+  {
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Convert values to big endian order in memory
+
+void binfile_put_values( unsigned char *dest, const int16_t *values, size_t count )
+{
+  for( size_t i = 0; i < count; i++ )
+  {
+    put_int16( dest + 2 * i, values[i] );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Write values in big endian order
+
+int binfile_write_values( FILE *file, const int16_t *values, size_t count )
+{
+  unsigned char buffer[WRITE_BUFFER_SIZE];
+
+  while( count > 0 )
+  {
+    size_t n = count;
+    if( n > WRITE_BUFFER_SIZE / 2 )
+    {
+      n = WRITE_BUFFER_SIZE / 2;
+    }
+    binfile_put_values( buffer, values, n );
+    if( fwrite( buffer, 2 * n, 1, file ) != 1 )
+    {
+      return -1;
+    }
+    values += n;
+    count -= n;
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// binfile.h - Memory mapped access to .bin height and mask files
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BINFILE_H
+#define BINFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// .bin files are signed 16 bit values, row by row starting at the south
+// west corner.  They may start with an optional header:
+//
+//   0  char[4]  magic "HGTB"
+//   4  uint8    version, 2
+//   5  uint8    flags, bit 0 set if min/max are valid, bit 1 set if the
+//               values are little endian
+//   6  uint8    sample type, 1 for signed 16 bit
+//   7  uint8    reserved, 0
+//   8  uint32   width
+//  12  uint32   height
+//  16  int16    minimum value
+//  18  int16    maximum value
+//  20  uint8[12] reserved, 0
+//
+// Header values are always big endian.  Files without a header, and
+// version 1 headers, which have no sample type, hold big endian values.
+// A header is only accepted if the file size matches the dimensions it
+// gives.  Headers are written as version 2 with big endian values, the
+// width and height can be anything, not just 2:1
+#define BINFILE_MAGIC "HGTB"
+#define BINFILE_HEADER_SIZE 32
+#define BINFILE_VERSION 2
+#define BINFILE_FLAG_RANGE 0x01
+#define BINFILE_FLAG_LITTLE_ENDIAN 0x02
+#define BINFILE_SAMPLE_INT16 1
+
+// Return codes from binfile_open
+#define BINFILE_OK 0
+#define BINFILE_ERR_OPEN -1
+#define BINFILE_ERR_SHORT -2
+#define BINFILE_ERR_SIZE -3
+#define BINFILE_ERR_FORMAT -4
+
+typedef struct
+{
+  int fd;
+  const unsigned char *map;     // whole file
+  size_t map_size;
+  const unsigned char *samples; // first value, after any header
+  int width;
+  int height;
+  int has_header;
+  int little_endian;            // values are little endian
+  int has_range;                // min and max are known
+  int min;
+  int max;
+} binfile_t;
+
+int binfile_open( binfile_t *bin, const char *file_name, int width, int height );
+const char *binfile_error( int code );
+void binfile_read_rows( const binfile_t *bin, int first_row, int rows, int16_t *dest );
+void binfile_will_need( const binfile_t *bin, int first_row, int rows );
+void binfile_done_with( const binfile_t *bin, int first_row, int rows );
+void binfile_min_max( binfile_t *bin, int *min, int *max );
+void binfile_close( binfile_t *bin );
+
+void binfile_make_header( unsigned char *header, int width, int height, int min, int max );
+void binfile_put_values( unsigned char *dest, const int16_t *values, size_t count );
+int binfile_write_header( FILE *file, int width, int height, int min, int max );
+int binfile_write_values( FILE *file, const int16_t *values, size_t count );
+
+// A single value, converted to host order
+static inline int16_t binfile_get( const binfile_t *bin, int x, int y )
+{
+  const unsigned char *p = bin->samples + 2 * ( (size_t)y * bin->width + x );
+  if( bin->little_endian )
+  {
+    return (int16_t)( p[0] | ( p[1] << 8 ) );
+  }
+  return (int16_t)( ( p[0] << 8 ) | p[1] );
+}
+
+#endif
@@ -0,0 +1,302 @@
+// colour.c - Height and mask to colour lookup
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "colour.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define COLOUR_AVX2
+#endif
+
+// Number of table entries for each mask class
+#define CLASS_SIZE 65536
+
+// ------------------------------------------------------------------------
+
+void colour_init( colour_t *colour )
+{
+  colour->land_gradient = NULL;
+  colour->land_rows = 0;
+  colour->sea_gradient = NULL;
+  colour->sea_rows = 0;
+  colour->table = NULL;
+}
+
+// ------------------------------------------------------------------------
+// Read a LUT file, this holds the red, green and blue channels one
+// after the other.  The number of entries comes from the size of the
+// file
+
+int colour_read_lut( FILE *file, unsigned char ( **lut )[3], int *rows )
+{
+  if( fseek( file, 0, SEEK_END ) != 0 )
+  {
+    return -1;
+  }
+  long size = ftell( file );
+  rewind( file );
+  if( ( size < 3 ) || ( size % 3 != 0 ) || ( size / 3 > COLOUR_MAX_ROWS ) )
+  {
+    return -1;
+  }
+  int count = size / 3;
+  unsigned char *channel = malloc( count );
+  unsigned char ( *entries )[3] = malloc( (size_t)count * 3 );
+  if( ( channel == NULL ) || ( entries == NULL ) )
+  {
+    free( channel );
+    free( entries );
+    return -1;
+  }
+  for( int c = 0; c < 3; c++ )
+  {
+    if( fread( channel, count, 1, file ) != 1 )
+    {
+      free( channel );
+      free( entries );
+      return -1;
+    }
+    for( int x = 0; x < count; x++ )
+    {
+      entries[x][c] = channel[x];
+    }
+  }
+  free( channel );
+  free( *lut );
+  *lut = entries;
+  *rows = count;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Work out the colour of every possible height for every mask class so
+// that colouring a point is a single lookup
+
+int colour_build_table( colour_t *colour, int min_height, int max_height )
+{
+  // Steps for shading
+  int land_rows = colour->land_rows;
+  int sea_rows = colour->sea_rows;
+  float land_step = (float) max_height / (float) land_rows;
+  float sea_step = (float) -min_height / (float) sea_rows;
+
+  colour->table = malloc( ( COLOUR_CLASSES + 1 ) * CLASS_SIZE * sizeof( uint32_t ) );
+  if( colour->table == NULL )
+  {
+    return -1;
+  }
+  uint32_t *land = colour->table;
+  uint32_t *sea = colour->table + 2 * CLASS_SIZE;
+  uint32_t *ice = colour->table + 5 * CLASS_SIZE;
+  uint32_t *invalid = colour->table + COLOUR_INVALID * CLASS_SIZE;
+  for( int height = INT16_MIN; height <= INT16_MAX; height++ )
+  {
+    uint16_t entry = (uint16_t)height;
+    int idx;
+
+    if( ( height < 0 ) || ( land_step <= 0 ) )
+    {
+      idx = 0;
+    }
+    else
+    {
+      idx = (float) height / land_step;
+      if( idx >= land_rows )
+      {
+        // May happen at maximum value so set it to maximum row in this case
+        idx = land_rows - 1;
+      }
+    }
+    land[entry] = COLOUR_RGB( colour->land_gradient[idx][0],
+                              colour->land_gradient[idx][1],
+                              colour->land_gradient[idx][2] );
+
+    if( ( height > 0 ) || ( sea_step <= 0 ) )
+    {
+      idx = 0;
+    }
+    else
+    {
+      idx = (float) -height / sea_step;
+      if( idx >= sea_rows )
+      {
+        // May happen at maximum value so set it to maximum row in this case
+        idx = sea_rows - 1;
+      }
+    }
+    sea[entry] = COLOUR_RGB( colour->sea_gradient[sea_rows - 1 - idx][0],
+                             colour->sea_gradient[sea_rows - 1 - idx][1],
+                             colour->sea_gradient[sea_rows - 1 - idx][2] );
+
+    ice[entry] = COLOUR_RGB( 255, 255, 255 );
+    invalid[entry] = COLOUR_RGB( 0, 0, 0 );
+  }
+  // Process mask
+  // http://ddfe.curtin.edu.au/models/Earth2014/readme_earth2014.dat
+  // 0 - land topography above mean sea level (MSL)
+  // 1 - land topography below MSL
+  // 2 - ocean bathymetry
+  // 3 - inland lake, bedrock above MSL
+  // 4 - inland lake, bedrock below MSL
+  // 5 - ice cover, bedrock above MSL
+  // 6 - ice cover, bedrock below MSL
+  // 7 - ice shelf
+  // 8 - ice covered lake (Vostok)
+  memcpy( colour->table + 1 * CLASS_SIZE, land, CLASS_SIZE * sizeof( uint32_t ) );
+  memcpy( colour->table + 3 * CLASS_SIZE, sea, CLASS_SIZE * sizeof( uint32_t ) );
+  memcpy( colour->table + 4 * CLASS_SIZE, sea, CLASS_SIZE * sizeof( uint32_t ) );
+  for( int class = 6; class <= 8; class++ )
+  {
+    memcpy( colour->table + class * CLASS_SIZE, ice, CLASS_SIZE * sizeof( uint32_t ) );
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Collect the different colours in the table.  If there are no more
+// than 256 then the palette is filled in, each table entry gets its
+// palette index and the number of colours is returned, otherwise -1
+
+int colour_make_palette( colour_t *colour, unsigned char palette[256][3] )
+{
+  uint32_t colours[256];
+  int count = 0;
+  uint32_t last = 0;
+  int last_index = -1;
+  size_t entries = ( COLOUR_CLASSES + 1 ) * CLASS_SIZE;
+
+  for( size_t i = 0; i < entries; i++ )
+  {
+    uint32_t rgb = colour->table[i] & 0xffffff;
+    int index;
+    // Neighbouring entries are usually the same
+    if( ( last_index >= 0 ) && ( rgb == last ) )
+    {
+      index = last_index;
+    }
+    else
+    {
+      for( index = 0; index < count; index++ )
+      {
+        if( colours[index] == rgb )
+        {
+          break;
+        }
+      }
+      if( index == count )
+      {
+        if( count == 256 )
+        {
+          // Too many, remove any indices already added
+          for( size_t j = 0; j < i; j++ )
+          {
+            colour->table[j] &= 0xffffff;
+          }
+          return -1;
+        }
+        colours[count++] = rgb;
+      }
+      last = rgb;
+      last_index = index;
+    }
+    colour->table[i] = rgb | ( (uint32_t)index << 24 );
+  }
+  for( int i = 0; i < count; i++ )
+  {
+    palette[i][0] = COLOUR_RED( colours[i] );
+    palette[i][1] = COLOUR_GREEN( colours[i] );
+    palette[i][2] = COLOUR_BLUE( colours[i] );
+  }
+  return count;
+}
+
+// ------------------------------------------------------------------------
+// Colour a row of points, returns the number of invalid mask values
+
+static int colour_row_scalar( const colour_t *colour, const int16_t *heights, const int16_t *mask,
+                              int count, uint32_t *out )
+{
+  int invalid = 0;
+
+  for( int x = 0; x < count; x++ )
+  {
+    if( (uint16_t)mask[x] >= COLOUR_CLASSES )
+    {
+      invalid++;
+    }
+    out[x] = colour_get( colour, heights[x], mask[x] );
+  }
+  return invalid;
+}
+
+#ifdef COLOUR_AVX2
+// Same again but 8 points at a time using gathers from the table
+__attribute__(( target( "avx2" ) ))
+static int colour_row_avx2( const colour_t *colour, const int16_t *heights, const int16_t *mask,
+                            int count, uint32_t *out )
+{
+  const __m256i last_valid = _mm256_set1_epi32( COLOUR_CLASSES - 1 );
+  const __m256i invalid_class = _mm256_set1_epi32( COLOUR_INVALID );
+  __m256i invalid = _mm256_setzero_si256();
+  int x;
+
+  for( x = 0; x + 8 <= count; x += 8 )
+  {
+    __m256i h = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i *)( heights + x ) ) );
+    __m256i m = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i *)( mask + x ) ) );
+    // Count and clamp invalid mask values, the compare gives -1 for each
+    invalid = _mm256_sub_epi32( invalid, _mm256_cmpgt_epi32( m, last_valid ) );
+    m = _mm256_min_epu32( m, invalid_class );
+    __m256i index = _mm256_or_si256( _mm256_slli_epi32( m, 16 ), h );
+    _mm256_storeu_si256( (__m256i *)( out + x ),
+                         _mm256_i32gather_epi32( (const int *)colour->table, index, 4 ) );
+  }
+  int lanes[8];
+  _mm256_storeu_si256( (__m256i *)lanes, invalid );
+  int total = 0;
+  for( int i = 0; i < 8; i++ )
+  {
+    total += lanes[i];
+  }
+  return total + colour_row_scalar( colour, heights + x, mask + x, count - x, out + x );
+}
+#endif
+
+int colour_row( const colour_t *colour, const int16_t *heights, const int16_t *mask,
+                int count, uint32_t *out )
+{
+#ifdef COLOUR_AVX2
+  if( __builtin_cpu_supports( "avx2" ) )
+  {
+    return colour_row_avx2( colour, heights, mask, count, out );
+  }
+#endif
+  return colour_row_scalar( colour, heights, mask, count, out );
+}
+
+// ------------------------------------------------------------------------
+
+void colour_free( colour_t *colour )
+{
+  free( colour->land_gradient );
+  free( colour->sea_gradient );
+  free( colour->table );
+  colour_init( colour );
+}
@@ -0,0 +1,75 @@
+// colour.h - Height and mask to colour lookup
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef COLOUR_H
+#define COLOUR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// LUT files hold all of the red values, then the green, then the
+// blue.  They can have any number of entries up to COLOUR_MAX_ROWS,
+// these are the usual sizes
+#define LAND_ROWS 256
+#define LAND_COLUMNS 3
+#define SEA_ROWS 256
+#define SEA_COLUMNS 3
+#define COLOUR_MAX_ROWS 65536
+
+// Mask values 0 - 8 are valid, anything else is shown as black
+#define COLOUR_CLASSES 9
+#define COLOUR_INVALID COLOUR_CLASSES
+
+// Table entries hold the colour in the bottom 24 bits and, if a palette
+// has been made, the palette index in the top 8 bits
+#define COLOUR_RGB( r, g, b ) ( (uint32_t)(r) | ( (uint32_t)(g) << 8 ) | ( (uint32_t)(b) << 16 ) )
+#define COLOUR_RED( c ) ( (c) & 0xff )
+#define COLOUR_GREEN( c ) ( ( (c) >> 8 ) & 0xff )
+#define COLOUR_BLUE( c ) ( ( (c) >> 16 ) & 0xff )
+#define COLOUR_INDEX( c ) ( (c) >> 24 )
+
+typedef struct
+{
+  unsigned char ( *land_gradient )[LAND_COLUMNS];  // land_rows entries
+  int land_rows;
+  unsigned char ( *sea_gradient )[SEA_COLUMNS];    // sea_rows entries
+  int sea_rows;
+  // One entry for every mask class and height, indexed by
+  // class * 65536 + (uint16_t)height, plus a last class for invalid
+  // mask values
+  uint32_t *table;
+} colour_t;
+
+void colour_init( colour_t *colour );
+int colour_read_lut( FILE *file, unsigned char ( **lut )[3], int *rows );
+int colour_build_table( colour_t *colour, int min_height, int max_height );
+int colour_make_palette( colour_t *colour, unsigned char palette[256][3] );
+int colour_row( const colour_t *colour, const int16_t *heights, const int16_t *mask,
+                int count, uint32_t *out );
+void colour_free( colour_t *colour );
+
+// Colour for a single point
+static inline uint32_t colour_get( const colour_t *colour, int16_t height, int16_t mask )
+{
+  unsigned int class = (uint16_t)mask;
+  if( class > COLOUR_INVALID )
+  {
+    class = COLOUR_INVALID;
+  }
+  return colour->table[( class << 16 ) + (uint16_t)height];
+}
+
+#endif
@@ -0,0 +1,90 @@
+// cube.c - Cube sphere geometry
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <stdlib.h>
+#include "cube.h"
+
+// Centre, u and v directions of each face.  u x v is the centre so
+// that faces built in u then v order face outwards
+static const int axes[CUBE_FACES][3][3] =
+{
+  { {  1, 0, 0 }, {  0, 1, 0 }, { 0,  0, 1 } },  // +X
+  { { -1, 0, 0 }, {  0,-1, 0 }, { 0,  0, 1 } },  // -X
+  { {  0, 1, 0 }, { -1, 0, 0 }, { 0,  0, 1 } },  // +Y
+  { {  0,-1, 0 }, {  1, 0, 0 }, { 0,  0, 1 } },  // -Y
+  { {  0, 0, 1 }, {  1, 0, 0 }, { 0,  1, 0 } },  // +Z
+  { {  0, 0,-1 }, {  1, 0, 0 }, { 0, -1, 0 } }   // -Z
+};
+
+// ------------------------------------------------------------------------
+
+int cube_init( cube_t *cube, int size )
+{
+  cube->size = size;
+  cube->tan = malloc( ( size + 1 ) * sizeof( double ) );
+  if( cube->tan == NULL )
+  {
+    return -1;
+  }
+  // Only work out the first half and mirror it, so that a point on
+  // the edge of one face is exactly the same as on the next face
+  for( int i = 0; i <= size / 2; i++ )
+  {
+    cube->tan[i] = tan( -M_PI / 4 + ( i * M_PI / 2 ) / size );
+    cube->tan[size - i] = -cube->tan[i];
+  }
+  cube->tan[0] = -1.0;
+  cube->tan[size] = 1.0;
+  if( size % 2 == 0 )
+  {
+    cube->tan[size / 2] = 0.0;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Unit vector to point i, j of a face
+
+void cube_direction( const cube_t *cube, int face, int i, int j, double *direction )
+{
+  const int (*axis)[3] = axes[face];
+  double u = cube->tan[i];
+  double v = cube->tan[j];
+
+  for( int k = 0; k < 3; k++ )
+  {
+    direction[k] = axis[0][k] + axis[1][k] * u + axis[2][k] * v;
+  }
+  // Always add up in x, y, z order so that the same point on two
+  // faces gives the same result
+  double length = sqrt( direction[0] * direction[0] + direction[1] * direction[1] +
+                        direction[2] * direction[2] );
+  for( int k = 0; k < 3; k++ )
+  {
+    direction[k] /= length;
+  }
+}
+
+// ------------------------------------------------------------------------
+
+void cube_free( cube_t *cube )
+{
+  free( cube->tan );
+  cube->tan = NULL;
+}
@@ -0,0 +1,36 @@
+// cube.h - Cube sphere geometry
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CUBE_H
+#define CUBE_H
+
+#define CUBE_FACES 6
+
+// A cube projected onto the unit sphere.  Each face is a grid of
+// size x size cells spaced at equal angles, so there are size + 1
+// points along each edge.  Points on the edges of neighbouring faces
+// come out exactly the same
+typedef struct
+{
+  int size;
+  double *tan;  // size + 1 values from -1 to 1
+} cube_t;
+
+int cube_init( cube_t *cube, int size );
+void cube_direction( const cube_t *cube, int face, int i, int j, double *direction );
+void cube_free( cube_t *cube );
+
+#endif
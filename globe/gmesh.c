@@ -0,0 +1,429 @@
+// gmesh.c - Compact globe mesh files
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+#include "gmesh.h"
+
+// ------------------------------------------------------------------------
+// Big endian helpers
+
+static uint32_t get_uint32( const unsigned char *p )
+{
+  return ( (uint32_t)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+static int16_t get_int16( const unsigned char *p )
+{
+  return (int16_t)( ( p[0] << 8 ) | p[1] );
+}
+
+static void put_uint32( unsigned char *p, uint32_t value )
+{
+  p[0] = ( value >> 24 ) & 0xff;
+  p[1] = ( value >> 16 ) & 0xff;
+  p[2] = ( value >> 8 ) & 0xff;
+  p[3] = value & 0xff;
+}
+
+static void put_int16( unsigned char *p, int16_t value )
+{
+  p[0] = ( (uint16_t)value >> 8 ) & 0xff;
+  p[1] = value & 0xff;
+}
+
+// ------------------------------------------------------------------------
+// Predict a height from its neighbours to the west, south and south
+// west, the median edge detector used by LOCO-I.  Missing neighbours
+// are taken from the ones that are there
+
+static inline int predict( const int16_t *row, const int16_t *below, int x )
+{
+  if( below == NULL )
+  {
+    return ( x > 0 ) ? row[x - 1] : 0;
+  }
+  if( x == 0 )
+  {
+    return below[0];
+  }
+  int a = row[x - 1];
+  int b = below[x];
+  int c = below[x - 1];
+  int low = ( a < b ) ? a : b;
+  int high = ( a < b ) ? b : a;
+  if( c >= high )
+  {
+    return low;
+  }
+  if( c <= low )
+  {
+    return high;
+  }
+  return a + b - c;
+}
+
+// Mask values are stored as their colour class
+static inline unsigned char mask_class( int16_t mask )
+{
+  return ( (uint16_t)mask > COLOUR_INVALID ) ? COLOUR_INVALID : (unsigned char)mask;
+}
+
+// ------------------------------------------------------------------------
+
+int gmesh_write_header( FILE *file, const gmesh_info_t *info )
+{
+  unsigned char header[GMESH_HEADER_SIZE];
+
+  memset( header, 0, sizeof( header ) );
+  memcpy( header, GMESH_MAGIC, 4 );
+  header[4] = GMESH_VERSION;
+  put_uint32( header + 8, info->xsize );
+  put_uint32( header + 12, info->ysize );
+  put_uint32( header + 16, info->planet_radius );
+  put_uint32( header + 20, info->magnification );
+  put_int16( header + 24, info->min_height );
+  put_int16( header + 26, info->max_height );
+  put_int16( header + 28, info->land_rows - 1 );
+  put_int16( header + 30, info->sea_rows - 1 );
+  if( ( fwrite( header, sizeof( header ), 1, file ) != 1 ) ||
+      ( fwrite( info->land_gradient, 3 * (size_t)info->land_rows, 1, file ) != 1 ) ||
+      ( fwrite( info->sea_gradient, 3 * (size_t)info->sea_rows, 1, file ) != 1 ) )
+  {
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int gmesh_writer_init( gmesh_writer_t *writer, int xsize, int max_rows, int level )
+{
+  size_t values = (size_t)xsize * max_rows;
+
+  writer->xsize = xsize;
+  writer->max_rows = max_rows;
+  writer->level = level;
+  writer->size = 0;
+  writer->capacity = GMESH_BLOCK_HEADER_SIZE + compressBound( 3 * values );
+  writer->planes = malloc( 3 * values );
+  writer->data = malloc( writer->capacity );
+  if( ( writer->planes == NULL ) || ( writer->data == NULL ) )
+  {
+    gmesh_writer_free( writer );
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Compress a block of rows into the writer's data, heights and mask
+// hold the rows one after the other
+
+int gmesh_encode_block( gmesh_writer_t *writer, int first_row, int rows,
+                        const int16_t *heights, const int16_t *mask )
+{
+  int xsize = writer->xsize;
+  size_t values = (size_t)xsize * rows;
+  unsigned char *low = writer->planes;
+  unsigned char *high = low + values;
+  unsigned char *classes = high + values;
+
+  if( rows > writer->max_rows )
+  {
+    return -1;
+  }
+  for( int y = 0; y < rows; y++ )
+  {
+    const int16_t *row = heights + (size_t)y * xsize;
+    const int16_t *below = ( y > 0 ) ? row - xsize : NULL;
+    size_t offset = (size_t)y * xsize;
+    for( int x = 0; x < xsize; x++ )
+    {
+      // Wraps round, which the decoder undoes
+      int16_t residual = (int16_t)(uint16_t)( row[x] - predict( row, below, x ) );
+      uint16_t code = ( (uint16_t)residual << 1 ) ^ (uint16_t)( residual >> 15 );
+      low[offset + x] = code & 0xff;
+      high[offset + x] = code >> 8;
+    }
+  }
+  for( size_t i = 0; i < values; i++ )
+  {
+    classes[i] = mask_class( mask[i] );
+  }
+  uLongf packed_size = writer->capacity - GMESH_BLOCK_HEADER_SIZE;
+  if( compress2( writer->data + GMESH_BLOCK_HEADER_SIZE, &packed_size,
+                 writer->planes, 3 * values, writer->level ) != Z_OK )
+  {
+    return -1;
+  }
+  put_uint32( writer->data, first_row );
+  put_uint32( writer->data + 4, rows );
+  put_uint32( writer->data + 8, packed_size );
+  writer->size = GMESH_BLOCK_HEADER_SIZE + packed_size;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+void gmesh_writer_free( gmesh_writer_t *writer )
+{
+  free( writer->planes );
+  free( writer->data );
+  writer->planes = NULL;
+  writer->data = NULL;
+}
+
+// ------------------------------------------------------------------------
+// Read the header of a file and set up everything needed to turn its
+// values back into verticies
+
+int gmesh_open( gmesh_reader_t *reader, FILE *file )
+{
+  unsigned char header[GMESH_HEADER_SIZE];
+  gmesh_info_t *info = &reader->info;
+
+  memset( reader, 0, sizeof( *reader ) );
+  reader->file = file;
+  if( fread( header, sizeof( header ), 1, file ) != 1 )
+  {
+    return GMESH_ERR_READ;
+  }
+  if( ( memcmp( header, GMESH_MAGIC, 4 ) != 0 ) || ( header[4] != GMESH_VERSION ) )
+  {
+    return GMESH_ERR_FORMAT;
+  }
+  info->xsize = get_uint32( header + 8 );
+  info->ysize = get_uint32( header + 12 );
+  info->planet_radius = (int32_t)get_uint32( header + 16 );
+  info->magnification = (int32_t)get_uint32( header + 20 );
+  info->min_height = get_int16( header + 24 );
+  info->max_height = get_int16( header + 26 );
+  if( ( info->xsize < 1 ) || ( info->ysize < 1 ) )
+  {
+    return GMESH_ERR_FORMAT;
+  }
+  // The colours come from the same table as makeglobe uses
+  colour_t *colour = &reader->colour;
+  colour_init( colour );
+  colour->land_rows = (uint16_t)get_int16( header + 28 ) + 1;
+  colour->sea_rows = (uint16_t)get_int16( header + 30 ) + 1;
+  colour->land_gradient = malloc( 3 * (size_t)colour->land_rows );
+  colour->sea_gradient = malloc( 3 * (size_t)colour->sea_rows );
+  if( ( colour->land_gradient == NULL ) || ( colour->sea_gradient == NULL ) )
+  {
+    return GMESH_ERR_MEMORY;
+  }
+  if( ( fread( colour->land_gradient, 3 * (size_t)colour->land_rows, 1, file ) != 1 ) ||
+      ( fread( colour->sea_gradient, 3 * (size_t)colour->sea_rows, 1, file ) != 1 ) )
+  {
+    return GMESH_ERR_READ;
+  }
+  info->land_gradient = colour->land_gradient;
+  info->land_rows = colour->land_rows;
+  info->sea_gradient = colour->sea_gradient;
+  info->sea_rows = colour->sea_rows;
+  if( colour_build_table( &reader->colour, info->min_height, info->max_height ) != 0 )
+  {
+    return GMESH_ERR_MEMORY;
+  }
+  // Tables of sin/cos values worked out the same way as makeglobe so
+  // that the verticies are the same
+  int xsize = info->xsize;
+  int ysize = info->ysize;
+  reader->lat_cos = malloc( ysize * sizeof( double ) );
+  reader->lat_sin = malloc( ysize * sizeof( double ) );
+  reader->lon_cos = malloc( xsize * sizeof( double ) );
+  reader->lon_sin = malloc( xsize * sizeof( double ) );
+  if( ( reader->lat_cos == NULL ) || ( reader->lat_sin == NULL ) ||
+      ( reader->lon_cos == NULL ) || ( reader->lon_sin == NULL ) )
+  {
+    return GMESH_ERR_MEMORY;
+  }
+  for( int y = 0; y < ysize; y++ )
+  {
+    float latitude = -90.0 + ( 180.0 / (float)ysize / 2 ) + ( (float)y * 180.0 ) / (float)ysize;
+    reader->lat_cos[y] = cos( latitude * M_PI / 180.0 );
+    reader->lat_sin[y] = sin( latitude * M_PI / 180.0 );
+  }
+  for( int x = 0; x < xsize; x++ )
+  {
+    float longitude = -180.0 + ( 360.0 / (float)xsize / 2 ) + ( (float)x * 360.0 ) / (float)xsize;
+    reader->lon_cos[x] = cos( longitude * M_PI / 180.0 );
+    reader->lon_sin[x] = sin( longitude * M_PI / 180.0 );
+  }
+  return GMESH_OK;
+}
+
+// ------------------------------------------------------------------------
+
+const char *gmesh_error( int code )
+{
+  switch( code )
+  {
+    case GMESH_OK:
+      return "no error";
+    case GMESH_ERR_READ:
+      return "file is too short";
+    case GMESH_ERR_FORMAT:
+      return "not a compact mesh file";
+    case GMESH_ERR_MEMORY:
+      return "out of memory";
+    case GMESH_ERR_DATA:
+      return "corrupt data";
+    default:
+      return "unknown error";
+  }
+}
+
+// ------------------------------------------------------------------------
+// Read and decode the next block of rows, returns 1 if a block was
+// read, 0 once all of the rows have been read or an error code
+
+int gmesh_read_block( gmesh_reader_t *reader )
+{
+  unsigned char header[GMESH_BLOCK_HEADER_SIZE];
+  int xsize = reader->info.xsize;
+
+  if( reader->next_row >= reader->info.ysize )
+  {
+    return 0;
+  }
+  if( fread( header, sizeof( header ), 1, reader->file ) != 1 )
+  {
+    return GMESH_ERR_READ;
+  }
+  uint32_t first_row = get_uint32( header );
+  uint32_t rows = get_uint32( header + 4 );
+  uint32_t packed_size = get_uint32( header + 8 );
+  if( ( first_row != (uint32_t)reader->next_row ) || ( rows < 1 ) ||
+      ( rows > (uint32_t)( reader->info.ysize - reader->next_row ) ) )
+  {
+    return GMESH_ERR_DATA;
+  }
+  // Buffers grow to fit the largest block
+  size_t values = (size_t)xsize * rows;
+  if( (int)rows > reader->max_rows )
+  {
+    int16_t *heights = realloc( reader->heights, values * sizeof( int16_t ) );
+    if( heights != NULL )
+    {
+      reader->heights = heights;
+    }
+    int16_t *mask = realloc( reader->mask, values * sizeof( int16_t ) );
+    if( mask != NULL )
+    {
+      reader->mask = mask;
+    }
+    unsigned char *planes = realloc( reader->planes, 3 * values );
+    if( planes != NULL )
+    {
+      reader->planes = planes;
+    }
+    if( ( heights == NULL ) || ( mask == NULL ) || ( planes == NULL ) )
+    {
+      return GMESH_ERR_MEMORY;
+    }
+    reader->max_rows = rows;
+  }
+  if( packed_size > reader->packed_size )
+  {
+    unsigned char *packed = realloc( reader->packed, packed_size );
+    if( packed == NULL )
+    {
+      return GMESH_ERR_MEMORY;
+    }
+    reader->packed = packed;
+    reader->packed_size = packed_size;
+  }
+  if( fread( reader->packed, packed_size, 1, reader->file ) != 1 )
+  {
+    return GMESH_ERR_READ;
+  }
+  uLongf unpacked_size = 3 * values;
+  if( ( uncompress( reader->planes, &unpacked_size, reader->packed, packed_size ) != Z_OK ) ||
+      ( unpacked_size != 3 * values ) )
+  {
+    return GMESH_ERR_DATA;
+  }
+  const unsigned char *low = reader->planes;
+  const unsigned char *high = low + values;
+  const unsigned char *classes = high + values;
+  for( uint32_t y = 0; y < rows; y++ )
+  {
+    int16_t *row = reader->heights + (size_t)y * xsize;
+    const int16_t *below = ( y > 0 ) ? row - xsize : NULL;
+    size_t offset = (size_t)y * xsize;
+    for( int x = 0; x < xsize; x++ )
+    {
+      uint16_t code = low[offset + x] | ( high[offset + x] << 8 );
+      int16_t residual = (int16_t)( ( code >> 1 ) ^ -( code & 1 ) );
+      row[x] = (int16_t)(uint16_t)( predict( row, below, x ) + residual );
+    }
+  }
+  for( size_t i = 0; i < values; i++ )
+  {
+    reader->mask[i] = classes[i];
+  }
+  reader->first_row = first_row;
+  reader->rows = rows;
+  reader->next_row += rows;
+  return 1;
+}
+
+// ------------------------------------------------------------------------
+// Position, normal and colour of a vertex, the row must be in the last
+// block read
+
+void gmesh_vertex( const gmesh_reader_t *reader, int x, int y, float *position, float *normal,
+                   uint32_t *colour )
+{
+  const gmesh_info_t *info = &reader->info;
+  size_t i = (size_t)( y - reader->first_row ) * info->xsize + x;
+  double lat_cos = reader->lat_cos[y];
+  double lat_sin = reader->lat_sin[y];
+
+  int radius = info->planet_radius + ( reader->heights[i] * info->magnification );
+  position[0] = radius * lat_cos * reader->lon_cos[x];
+  position[1] = radius * lat_cos * reader->lon_sin[x];
+  position[2] = radius * lat_sin;
+  normal[0] = ( info->planet_radius * 2 * lat_cos * reader->lon_cos[x] );
+  normal[1] = ( info->planet_radius * 2 * lat_cos * reader->lon_sin[x] );
+  normal[2] = ( info->planet_radius * 2 * lat_sin );
+  *colour = colour_get( &reader->colour, reader->heights[i], reader->mask[i] );
+}
+
+// ------------------------------------------------------------------------
+
+void gmesh_close( gmesh_reader_t *reader )
+{
+  colour_free( &reader->colour );
+  free( reader->heights );
+  free( reader->mask );
+  free( reader->planes );
+  free( reader->packed );
+  free( reader->lat_cos );
+  free( reader->lat_sin );
+  free( reader->lon_cos );
+  free( reader->lon_sin );
+  memset( reader, 0, sizeof( *reader ) );
+}
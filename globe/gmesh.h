@@ -0,0 +1,135 @@
+// gmesh.h - Compact globe mesh files
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef GMESH_H
+#define GMESH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "colour.h"
+
+// A latitude/longitude grid mesh is fully described by its heights and
+// mask values, so that is all that is stored.  Positions, normals and
+// colours are worked out again when the file is read, exactly as
+// makeglobe works them out.  The file starts with a header:
+//
+//   0  char[4]  magic "GMSH"
+//   4  uint8    version, 1
+//   5  uint8[3] reserved, 0
+//   8  uint32   xsize
+//  12  uint32   ysize
+//  16  int32    planet radius
+//  20  int32    magnification
+//  24  int16    minimum height used for shading
+//  26  int16    maximum height used for shading
+//  28  uint16   terrain LUT entries - 1
+//  30  uint16   bathymetry LUT entries - 1
+//  32  uint8    terrain LUT, red, green, blue for each entry
+//   .. uint8    bathymetry LUT, red, green, blue for each entry
+//
+// followed by blocks of rows, south first, each with a header:
+//
+//   0  uint32   first row
+//   4  uint32   number of rows
+//   8  uint32   size of the compressed data that follows
+//
+// The compressed data is a zlib stream holding, for every value of the
+// block, the low bytes of the height residuals, then the high bytes,
+// then the mask classes.  Residuals are the difference from a value
+// predicted from the neighbours to the west, south and south west in
+// the same block, zig-zag coded so that small differences either way
+// have small codes.  Blocks can be decoded one at a time, in order.
+// All values are big endian like .bin files
+#define GMESH_MAGIC "GMSH"
+#define GMESH_HEADER_SIZE 32
+#define GMESH_BLOCK_HEADER_SIZE 12
+#define GMESH_VERSION 1
+// Files are written once and read many times so compress them hard
+#define GMESH_LEVEL 9
+
+// Return codes from gmesh_open
+#define GMESH_OK 0
+#define GMESH_ERR_READ -1
+#define GMESH_ERR_FORMAT -2
+#define GMESH_ERR_MEMORY -3
+#define GMESH_ERR_DATA -4
+
+// Everything in the file header
+typedef struct
+{
+  int xsize;
+  int ysize;
+  int planet_radius;
+  int magnification;
+  int min_height;
+  int max_height;
+  const unsigned char ( *land_gradient )[LAND_COLUMNS];
+  int land_rows;
+  const unsigned char ( *sea_gradient )[SEA_COLUMNS];
+  int sea_rows;
+} gmesh_info_t;
+
+// Workspace for compressing blocks of up to max_rows rows, the last
+// block made is in data
+typedef struct
+{
+  int xsize;
+  int max_rows;
+  int level;            // zlib compression level
+  unsigned char *planes;
+  unsigned char *data;  // block header and compressed data
+  size_t size;
+  size_t capacity;
+} gmesh_writer_t;
+
+// A file being read, the last block read is in heights and mask.  The
+// LUTs in info belong to colour
+typedef struct
+{
+  FILE *file;
+  gmesh_info_t info;
+  colour_t colour;
+  int next_row;
+  int max_rows;         // rows that heights and mask can hold
+  int first_row;
+  int rows;
+  int16_t *heights;
+  int16_t *mask;
+  unsigned char *planes;
+  unsigned char *packed;
+  size_t packed_size;
+  // sin/cos of the latitude of each row and longitude of each column
+  double *lat_cos;
+  double *lat_sin;
+  double *lon_cos;
+  double *lon_sin;
+} gmesh_reader_t;
+
+int gmesh_write_header( FILE *file, const gmesh_info_t *info );
+int gmesh_writer_init( gmesh_writer_t *writer, int xsize, int max_rows, int level );
+int gmesh_encode_block( gmesh_writer_t *writer, int first_row, int rows,
+                        const int16_t *heights, const int16_t *mask );
+void gmesh_writer_free( gmesh_writer_t *writer );
+
+int gmesh_open( gmesh_reader_t *reader, FILE *file );
+const char *gmesh_error( int code );
+int gmesh_read_block( gmesh_reader_t *reader );
+void gmesh_vertex( const gmesh_reader_t *reader, int x, int y, float *position, float *normal,
+                   uint32_t *colour );
+void gmesh_close( gmesh_reader_t *reader );
+
+#endif
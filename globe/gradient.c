@@ -1,4 +1,4 @@
-// gradient.c - Extract colour gradient
+// gradient.c - Colour gradient to LUT compiler
 // Copyright (C) 2020 John Davies
 //
 // This program is free software: you can redistribute it and/or modify
@@ -14,21 +14,374 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#define _USE_MATH_DEFINES
+
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include <string.h>
+#include <unistd.h>
+#include "colour.h"
+
+#define LINE_SIZE 1024
+// Segments shorter than this are treated as a single point, as GIMP
+// does
+#define EPSILON 1e-10
+
+// How the colour changes across a segment
+typedef enum
+{
+  BLEND_LINEAR,
+  BLEND_CURVED,
+  BLEND_SINE,
+  BLEND_SPHERE_INCREASING,
+  BLEND_SPHERE_DECREASING,
+  BLEND_STEP
+} blend_t;
+
+// How the two end colours are mixed
+typedef enum
+{
+  MIX_RGB,
+  MIX_HSV_CCW,
+  MIX_HSV_CW
+} mix_t;
+
+// One segment of a GIMP gradient, colours are red, green, blue and
+// alpha from 0 to 1
+typedef struct
+{
+  double left;
+  double middle;
+  double right;
+  double left_colour[4];
+  double right_colour[4];
+  blend_t blend;
+  mix_t mix;
+} segment_t;
+
+// ------------------------------------------------------------------------
+// Read a GIMP .ggr file, returns the number of segments or -1 if the
+// file can't be read
+
+static int read_ggr( FILE *file, segment_t **segments )
+{
+  char line[LINE_SIZE];
+  int count;
+
+  if( ( fgets( line, LINE_SIZE, file ) == NULL ) || ( strncmp( line, "GIMP Gradient", 13 ) != 0 ) )
+  {
+    return -1;
+  }
+  // Older files have no name
+  if( fgets( line, LINE_SIZE, file ) == NULL )
+  {
+    return -1;
+  }
+  if( ( strncmp( line, "Name:", 5 ) == 0 ) && ( fgets( line, LINE_SIZE, file ) == NULL ) )
+  {
+    return -1;
+  }
+  if( ( sscanf( line, "%d", &count ) != 1 ) || ( count < 1 ) )
+  {
+    return -1;
+  }
+  *segments = malloc( count * sizeof( segment_t ) );
+  if( *segments == NULL )
+  {
+    return -1;
+  }
+  for( int i = 0; i < count; i++ )
+  {
+    segment_t *s = &( *segments )[i];
+    int blend, mix;
+    int left_type = 0;
+    int right_type = 0;
+    int fields;
+    if( fgets( line, LINE_SIZE, file ) == NULL )
+    {
+      return -1;
+    }
+    // The colour types at the end are missing from older files
+    fields = sscanf( line, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %d %d %d %d",
+                     &s->left, &s->middle, &s->right,
+                     &s->left_colour[0], &s->left_colour[1], &s->left_colour[2], &s->left_colour[3],
+                     &s->right_colour[0], &s->right_colour[1], &s->right_colour[2], &s->right_colour[3],
+                     &blend, &mix, &left_type, &right_type );
+    if( ( fields != 13 ) && ( fields != 15 ) )
+    {
+      return -1;
+    }
+    if( ( blend < BLEND_LINEAR ) || ( blend > BLEND_STEP ) || ( mix < MIX_RGB ) || ( mix > MIX_HSV_CW ) )
+    {
+      return -1;
+    }
+    s->blend = blend;
+    s->mix = mix;
+    // Foreground and background colours depend on GIMP's settings, the
+    // colours saved in the file are used instead
+    if( ( left_type != 0 ) || ( right_type != 0 ) )
+    {
+      printf( "WARNING: segment %d uses foreground or background colours, using the saved colours\n", i );
+    }
+  }
+  return count;
+}
+
+// ------------------------------------------------------------------------
+// How far across a segment the colour is, 0 at the left end and 1 at
+// the right.  pos and middle are fractions of the segment, these are
+// the same sums that GIMP uses
+
+static double linear_factor( double middle, double pos )
+{
+  if( pos <= middle )
+  {
+    return ( middle < EPSILON ) ? 0.0 : 0.5 * pos / middle;
+  }
+  pos -= middle;
+  middle = 1.0 - middle;
+  return ( middle < EPSILON ) ? 1.0 : 0.5 + 0.5 * pos / middle;
+}
+
+static double blend_factor( blend_t blend, double middle, double pos )
+{
+  double factor;
+
+  switch( blend )
+  {
+    case BLEND_CURVED:
+      if( middle < EPSILON )
+      {
+        middle = EPSILON;
+      }
+      return pow( pos, log( 0.5 ) / log( middle ) );
+    case BLEND_SINE:
+      factor = linear_factor( middle, pos );
+      return ( sin( -M_PI / 2.0 + M_PI * factor ) + 1.0 ) / 2.0;
+    case BLEND_SPHERE_INCREASING:
+      factor = linear_factor( middle, pos ) - 1.0;
+      return sqrt( 1.0 - factor * factor );
+    case BLEND_SPHERE_DECREASING:
+      factor = linear_factor( middle, pos );
+      return 1.0 - sqrt( 1.0 - factor * factor );
+    case BLEND_STEP:
+      return ( pos >= middle ) ? 1.0 : 0.0;
+    default:
+      return linear_factor( middle, pos );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Hue, saturation and value all from 0 to 1
+
+static void rgb_to_hsv( const double *rgb, double *hsv )
+{
+  double max = fmax( rgb[0], fmax( rgb[1], rgb[2] ) );
+  double min = fmin( rgb[0], fmin( rgb[1], rgb[2] ) );
+  double delta = max - min;
+
+  hsv[2] = max;
+  hsv[1] = ( max > 0.0 ) ? delta / max : 0.0;
+  if( delta <= 0.0 )
+  {
+    hsv[0] = 0.0;
+    return;
+  }
+  if( rgb[0] == max )
+  {
+    hsv[0] = ( rgb[1] - rgb[2] ) / delta;
+  }
+  else if( rgb[1] == max )
+  {
+    hsv[0] = 2.0 + ( rgb[2] - rgb[0] ) / delta;
+  }
+  else
+  {
+    hsv[0] = 4.0 + ( rgb[0] - rgb[1] ) / delta;
+  }
+  hsv[0] /= 6.0;
+  if( hsv[0] < 0.0 )
+  {
+    hsv[0] += 1.0;
+  }
+}
+
+static void hsv_to_rgb( const double *hsv, double *rgb )
+{
+  double h = hsv[0] * 6.0;
+  double s = hsv[1];
+  double v = hsv[2];
+
+  if( s <= 0.0 )
+  {
+    rgb[0] = rgb[1] = rgb[2] = v;
+    return;
+  }
+  if( h >= 6.0 )
+  {
+    h = 0.0;
+  }
+  int sector = (int)h;
+  double f = h - sector;
+  double p = v * ( 1.0 - s );
+  double q = v * ( 1.0 - s * f );
+  double t = v * ( 1.0 - s * ( 1.0 - f ) );
+  switch( sector )
+  {
+    case 0: rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+    case 1: rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+    case 2: rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+    case 3: rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+    case 4: rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+    default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+  }
+}
+
+// ------------------------------------------------------------------------
+// Colour of the gradient at a position from 0 to 1
+
+static void gradient_colour( const segment_t *segments, int count, double pos, double *colour )
+{
+  const segment_t *s = &segments[count - 1];
+
+  for( int i = 0; i < count; i++ )
+  {
+    if( pos <= segments[i].right )
+    {
+      s = &segments[i];
+      break;
+    }
+  }
+  double length = s->right - s->left;
+  double middle = 0.5;
+  if( length < EPSILON )
+  {
+    pos = 0.5;
+  }
+  else
+  {
+    middle = ( s->middle - s->left ) / length;
+    pos = ( pos - s->left ) / length;
+  }
+  double factor = blend_factor( s->blend, middle, pos );
+
+  if( s->mix == MIX_RGB )
+  {
+    for( int c = 0; c < 3; c++ )
+    {
+      colour[c] = s->left_colour[c] + ( s->right_colour[c] - s->left_colour[c] ) * factor;
+    }
+  }
+  else
+  {
+    // Hue goes round the colour wheel the way asked for
+    double left[3], right[3], hsv[3];
+    rgb_to_hsv( s->left_colour, left );
+    rgb_to_hsv( s->right_colour, right );
+    hsv[1] = left[1] + ( right[1] - left[1] ) * factor;
+    hsv[2] = left[2] + ( right[2] - left[2] ) * factor;
+    if( s->mix == MIX_HSV_CCW )
+    {
+      if( left[0] < right[0] )
+      {
+        hsv[0] = left[0] + ( right[0] - left[0] ) * factor;
+      }
+      else
+      {
+        hsv[0] = left[0] + ( 1.0 - ( left[0] - right[0] ) ) * factor;
+        if( hsv[0] > 1.0 )
+        {
+          hsv[0] -= 1.0;
+        }
+      }
+    }
+    else
+    {
+      if( right[0] < left[0] )
+      {
+        hsv[0] = left[0] - ( left[0] - right[0] ) * factor;
+      }
+      else
+      {
+        hsv[0] = left[0] - ( 1.0 - ( right[0] - left[0] ) ) * factor;
+        if( hsv[0] < 0.0 )
+        {
+          hsv[0] += 1.0;
+        }
+      }
+    }
+    hsv_to_rgb( hsv, colour );
+  }
+  colour[3] = s->left_colour[3] + ( s->right_colour[3] - s->left_colour[3] ) * factor;
+}
+
+// ------------------------------------------------------------------------
+
+static int to_byte( double value )
+{
+  int byte = lrint( value * 255.0 );
+  return ( byte < 0 ) ? 0 : ( ( byte > 255 ) ? 255 : byte );
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: gradient [options] <input file> [output file]\n" );
+  printf( "  ( input is a GIMP .ggr gradient, output is a LUT for makeimage and makeglobe )\n" );
+  printf( "  Options:\n" );
+  printf( "    -n entries        entries in the LUT, up to %d, default %d\n", COLOUR_MAX_ROWS, LAND_ROWS );
+  printf( "    -r                reverse the gradient\n" );
+  printf( "    -p                print the entries as {r, g, b, a} instead of\n" );
+  printf( "                      writing a LUT\n" );
+}
+
+// ------------------------------------------------------------------------
 
 int main( int argc, char *argv[] )
 {
-  FILE* input_file;
+  FILE *input_file;
+  int entries = LAND_ROWS;
+  int reverse = 0;
+  int print = 0;
+  int opt;
+
+  printf( "Gradient compiler, v0.2\n" );
 
-  printf( "Gradient extractor, v0.1\n" );
+  // Check options
+  while( ( opt = getopt( argc, argv, "+n:rp" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'n':
+        entries = atoi( optarg );
+        if( ( entries < 1 ) || ( entries > COLOUR_MAX_ROWS ) )
+        {
+          printf( "ERROR: invalid number of entries: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'r':
+        reverse = 1;
+        break;
+      case 'p':
+        print = 1;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that the positional arguments are
+  // numbered as before
+  argc -= optind - 1;
+  argv += optind - 1;
 
   // Check command line
-  if( argc != 2 )
+  if( argc != ( print ? 2 : 3 ) )
   {
-    printf( "ERROR: usage is: gradient <input file>\n" );
+    usage();
     return EXIT_FAILURE;
   }
   // Check input file
@@ -39,19 +392,63 @@ int main( int argc, char *argv[] )
     return EXIT_FAILURE;
   }
   // Read input file
-  int rows, columns, n;
-  unsigned char *data = stbi_load( argv[1], &columns, &rows, &n, 0);
-  if( data == NULL )
+  segment_t *segments = NULL;
+  int count = read_ggr( input_file, &segments );
+  if( count < 0 )
+  {
+    printf( "ERROR: failed to read GIMP gradient file: %s\n", argv[1] );
+    return EXIT_FAILURE;
+  }
+  fclose( input_file );
+  printf( "Read %d segments\n", count );
+
+  // Sample the gradient at evenly spaced points, the first and last
+  // entries are the two ends.  LUTs are stored as all of the red
+  // values, then the green and then the blue
+  unsigned char *lut = malloc( (size_t)entries * 4 );
+  if( lut == NULL )
   {
-    printf( "ERROR - failed to read file\n" );
+    printf( "ERROR: could not allocate LUT\n" );
     return EXIT_FAILURE;
   }
-  printf( "Read %d rows, %d columns, %d channels\n", rows, columns, n );
-  for( int i = 0; i < columns; i++ )
+  for( int i = 0; i < entries; i++ )
+  {
+    double pos = ( entries > 1 ) ? (double)i / ( entries - 1 ) : 0.0;
+    double colour[4];
+    if( reverse )
+    {
+      pos = 1.0 - pos;
+    }
+    gradient_colour( segments, count, pos, colour );
+    for( int c = 0; c < 4; c++ )
+    {
+      lut[(size_t)c * entries + i] = to_byte( colour[c] );
+    }
+  }
+  if( print )
+  {
+    for( int i = 0; i < entries; i++ )
+    {
+      printf( "{%d, %d, %d, %d },\n", lut[i], lut[entries + i], lut[2 * entries + i], lut[3 * entries + i] );
+    }
+  }
+  else
   {
-    int index = n * i;
-    printf( "{%d, %d, %d, %d },\n", data[index], data[index+1], data[index+2], data[index+3] );
+    FILE *output_file = fopen( argv[2], "wb" );
+    if( output_file == NULL )
+    {
+      printf( "ERROR: could not open output file: %s\n", argv[2] );
+      return EXIT_FAILURE;
+    }
+    if( ( fwrite( lut, (size_t)entries * 3, 1, output_file ) != 1 ) || ( fclose( output_file ) != 0 ) )
+    {
+      printf( "ERROR: failed to write output file: %s\n", argv[2] );
+      return EXIT_FAILURE;
+    }
+    printf( "%d entries written\n", entries );
   }
+  free( lut );
+  free( segments );
 
   return EXIT_SUCCESS;
 }
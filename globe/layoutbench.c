@@ -0,0 +1,162 @@
+// layoutbench.c - Compares the old column major heightfield layout with
+//                 the row major one used by the band reader
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Size of 1 arc minute files
+#define SIZE_X 21600
+
+// ------------------------------------------------------------------------
+// Cache miss counter, returns -1 if the kernel won't allow it
+
+static int open_counter( void )
+{
+  struct perf_event_attr attr;
+
+  memset( &attr, 0, sizeof( attr ) );
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof( attr );
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ------------------------------------------------------------------------
+// Walk the grid the way the tools do, rows in the outer loop and
+// columns in the inner loop, with values at x_stride * x + y_stride * y
+
+static long walk( const int16_t *grid, int xsize, int ysize, size_t x_stride, size_t y_stride )
+{
+  long total = 0;
+
+  for( int y = 0; y < ysize; y++ )
+  {
+    for( int x = 0; x < xsize; x++ )
+    {
+      total += grid[x * x_stride + y * y_stride] >> 4;
+    }
+  }
+  return total;
+}
+
+// ------------------------------------------------------------------------
+
+static void run( const char *name, const int16_t *grid, int xsize, int ysize,
+                 size_t x_stride, size_t y_stride, int counter )
+{
+  long long misses = -1;
+
+  if( counter >= 0 )
+  {
+    ioctl( counter, PERF_EVENT_IOC_RESET, 0 );
+    ioctl( counter, PERF_EVENT_IOC_ENABLE, 0 );
+  }
+  double start = now();
+  long total = walk( grid, xsize, ysize, x_stride, y_stride );
+  double elapsed = now() - start;
+  if( counter >= 0 )
+  {
+    ioctl( counter, PERF_EVENT_IOC_DISABLE, 0 );
+    if( read( counter, &misses, sizeof( misses ) ) != sizeof( misses ) )
+    {
+      misses = -1;
+    }
+  }
+  printf( "%-14s %10.3f s %12.1f Mvalues/s", name, elapsed, xsize * (double)ysize / elapsed / 1e6 );
+  if( misses >= 0 )
+  {
+    printf( " %14lld cache misses", misses );
+  }
+  else
+  {
+    printf( "   cache misses not available" );
+  }
+  printf( "   (check %ld)\n", total );
+}
+
+// ------------------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+  int xsize = SIZE_X;
+
+  printf( "layoutbench, v0.1\n" );
+
+  // Check command line
+  if( argc > 2 )
+  {
+    printf( "ERROR: usage is: layoutbench [xsize]\n" );
+    return EXIT_FAILURE;
+  }
+  if( argc == 2 )
+  {
+    xsize = atoi( argv[1] );
+    if( ( xsize < 2 ) || ( xsize % 2 != 0 ) )
+    {
+      printf( "ERROR: invalid X size: %s\n", argv[1] );
+      return EXIT_FAILURE;
+    }
+  }
+  int ysize = xsize / 2;
+  size_t count = (size_t)xsize * ysize;
+
+  int16_t *grid = malloc( count * sizeof( int16_t ) );
+  if( grid == NULL )
+  {
+    printf( "ERROR: could not allocate %d x %d grid\n", xsize, ysize );
+    return EXIT_FAILURE;
+  }
+  // The contents don't matter but the pages need to be touched
+  uint32_t seed = 1;
+  for( size_t i = 0; i < count; i++ )
+  {
+    seed = seed * 1103515245 + 12345;
+    grid[i] = seed >> 16;
+  }
+
+  int counter = open_counter();
+  printf( "Grid: %d x %d, %zu MB\n", xsize, ysize, count * sizeof( int16_t ) / ( 1024 * 1024 ) );
+  // Old layout was original[x][y], so x steps by ysize
+  run( "column major", grid, xsize, ysize, ysize, 1, counter );
+  // New layout is row by row, so x steps by 1
+  run( "row major", grid, xsize, ysize, 1, xsize, counter );
+
+  if( counter >= 0 )
+  {
+    close( counter );
+  }
+  free( grid );
+  return EXIT_SUCCESS;
+}
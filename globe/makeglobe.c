@@ -20,31 +20,1077 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "makeglobe.h"
+#include "ply.h"
+#include "band.h"
+#include "cube.h"
+#include "gmesh.h"
+#include "progress.h"
 
-// Size of 1 arc minute files
-#define SIZE_X 21600
-#define SIZE_Y 10800
 #define OUTPUT_FILE_NAME_SIZE 1024
+// Rows given to each thread at a time, this limits the size of the
+// per thread output buffers
+#define JOB_ROWS 8
+// Size of the tiles of a tiled mesh.  Tiles must be narrow enough that
+// two rows of verticies, with one to spare, fit in a typical 32 entry
+// GPU vertex cache
+#define TILE_ROWS JOB_ROWS
+#define TILE_COLUMNS 14
+// Fewest points in a row of an adaptive mesh, and the longest run of
+// candidate points that can be dropped, which bounds the work of
+// splitting a row
+#define MIN_ROW_POINTS 3
+#define MAX_GAP 1024
+// Tolerances tried when meeting a triangle budget.  After 0 they are
+// evenly spaced in log from TOLERANCE_MIN to TOLERANCE_MAX times the
+// planet radius
+#define TOLERANCE_STEPS 4096
+#define TOLERANCE_MIN 1e-7
+#define TOLERANCE_MAX 4.0
 
-// Used for writing image
-#define RGB(r, g, b ) ((r) | ((g) << 8) | ((b) << 16))
+int max_height;
+int min_height;
 
-// Array to store original file and mask file
-// Note that this may not be portable
-int16_t original[SIZE_X][SIZE_Y];
-int16_t mask[SIZE_X][SIZE_Y];
+// Everything the worker threads need to build the model, read only
+// once it has been set up
+typedef struct
+{
+  int xsize;
+  int ysize;
+  int planet_radius;
+  int magnification;
+  colour_t *colour;
+  // sin/cos of the latitude of each row and longitude of each column
+  double *lat_cos;
+  double *lat_sin;
+  double *lon_cos;
+  double *lon_sin;
+  band_t *heights;
+  band_t *mask;
+  // Normals worked out from the slope of the terrain
+  int terrain_normals;
+  // Verticies and faces written a tile at a time
+  int tiled;
+  // Cube sphere mesh, the input is sampled directly from the files
+  cube_t *cube;
+  const binfile_t *input_bin;
+  const binfile_t *mask_bin;
+  // Adaptive mesh, each row only keeps some of its columns
+  int adaptive;
+  double tolerance;   // largest distance a dropped point can be from the mesh
+  int *row_counts;    // columns kept in each row
+  int **row_columns;  // the columns, NULL if only counting
+  int *row_first;     // index of the first vertex of each row
+  double *tolerances; // TOLERANCE_STEPS tolerances tried for a budget
+} globe_t;
 
-unsigned char land_gradient[LAND_ROWS][LAND_COLUMNS];
-unsigned char sea_gradient[SEA_ROWS][SEA_COLUMNS];
+// A run of candidate points in a row, to be split at the one farthest
+// from the line across it
+typedef struct
+{
+  int first;
+  int last;
+  double error;       // error of the point that made the run
+} run_t;
 
-int max_height;
-int min_height;
+// A block of rows given to one thread, the output is built up in the
+// buffer and then written out in order by the main thread
+typedef struct
+{
+  const globe_t *globe;
+  int first_row;
+  int last_row;
+  ply_buffer_t buffer;
+  // Colours and terrain normals of the current rows
+  uint32_t *colours;
+  float *normals;
+  double *radii;
+  int invalid_count;
+  // Adaptive row selection workspace
+  int *kept;
+  double *points;
+  double *errors;
+  run_t *runs;
+  // Candidate points, and those in the top and bottom rows, counted by
+  // the first of the tolerances that drops them
+  int64_t *histogram;
+  int64_t *end_histogram;
+  // Compact output workspace
+  gmesh_writer_t writer;
+  int status;
+} job_t;
+
+// ------------------------------------------------------------------------
+// Position of a point of the model
+
+static void globe_point( const globe_t *globe, int x, int y, int16_t height, double *point )
+{
+  int radius = globe->planet_radius + ( height * globe->magnification );
+  point[0] = radius * globe->lat_cos[y] * globe->lon_cos[x];
+  point[1] = radius * globe->lat_cos[y] * globe->lon_sin[x];
+  point[2] = radius * globe->lat_sin[y];
+}
+
+// ------------------------------------------------------------------------
+// Find the point between a and b farthest from the straight line from a
+// to b, returns its index and sets its squared distance
+
+static int farthest_point( const double *points, int a, int b, double *farthest )
+{
+  const double *pa = points + 3 * a;
+  const double *pb = points + 3 * b;
+  double ab[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+  double length = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+  int index = a + 1;
+
+  *farthest = -1.0;
+  for( int k = a + 1; k < b; k++ )
+  {
+    const double *p = points + 3 * k;
+    double ap[3] = { p[0] - pa[0], p[1] - pa[1], p[2] - pa[2] };
+    double t = 0.0;
+    if( length > 0.0 )
+    {
+      t = ( ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2] ) / length;
+      t = ( t < 0.0 ) ? 0.0 : ( ( t > 1.0 ) ? 1.0 : t );
+    }
+    double distance = 0.0;
+    for( int i = 0; i < 3; i++ )
+    {
+      double d = ap[i] - t * ab[i];
+      distance += d * d;
+    }
+    if( distance > *farthest )
+    {
+      *farthest = distance;
+      index = k;
+    }
+  }
+  return index;
+}
+
+// ------------------------------------------------------------------------
+// Work out the error of each candidate point in a row of an adaptive
+// mesh, returns the number of candidates.  The row is sampled in
+// proportion to cos(latitude) so that rows get fewer points towards the
+// poles.  Each run between fixed points is split at the point farthest
+// from the line across it, and the two halves split in turn, as in
+// Douglas-Peucker.  A point's error is its distance from that line but
+// no more than the error of the point that made its run, so at any
+// tolerance the points kept are just those with a larger error.  Column
+// 0 is fixed so that every row starts at the same longitude, as are
+// enough others that no run is longer than MAX_GAP and no row has fewer
+// than MIN_ROW_POINTS points
+
+static int row_errors( const globe_t *globe, job_t *job, int y, const int16_t *height_row )
+{
+  int xsize = globe->xsize;
+  int candidates = ceil( xsize * globe->lat_cos[y] );
+  if( candidates < MIN_ROW_POINTS )
+  {
+    candidates = MIN_ROW_POINTS;
+  }
+  if( candidates > xsize )
+  {
+    candidates = xsize;
+  }
+  // The last point is the first one again so that the row wraps round
+  for( int k = 0; k < candidates; k++ )
+  {
+    int x = (int64_t)k * xsize / candidates;
+    globe_point( globe, x, y, height_row[x], job->points + 3 * k );
+  }
+  globe_point( globe, 0, y, height_row[0], job->points + 3 * candidates );
+
+  int spacing = candidates / MIN_ROW_POINTS;
+  if( spacing > MAX_GAP )
+  {
+    spacing = MAX_GAP;
+  }
+  int count = 0;
+  for( int a = 0; a < candidates; a += spacing )
+  {
+    job->errors[a] = HUGE_VAL;
+    job->runs[count].first = a;
+    job->runs[count].last = ( a + spacing < candidates ) ? a + spacing : candidates;
+    job->runs[count].error = HUGE_VAL;
+    count++;
+  }
+  // Each split replaces one run with two, so there are never more runs
+  // than candidates
+  while( count > 0 )
+  {
+    run_t run = job->runs[--count];
+    if( run.last - run.first < 2 )
+    {
+      continue;
+    }
+    double distance;
+    int k = farthest_point( job->points, run.first, run.last, &distance );
+    double error = sqrt( distance );
+    if( error > run.error )
+    {
+      error = run.error;
+    }
+    job->errors[k] = error;
+    job->runs[count].first = run.first;
+    job->runs[count].last = k;
+    job->runs[count].error = error;
+    count++;
+    job->runs[count].first = k;
+    job->runs[count].last = run.last;
+    job->runs[count].error = error;
+    count++;
+  }
+  return candidates;
+}
+
+// ------------------------------------------------------------------------
+// Index of the first of the tolerances tried that drops a point with
+// this error, TOLERANCE_STEPS if none of them do
+
+static int tolerance_step( const globe_t *globe, double error )
+{
+  const double *tolerances = globe->tolerances;
+
+  if( error <= 0.0 )
+  {
+    return 0;
+  }
+  if( error > tolerances[TOLERANCE_STEPS - 1] )
+  {
+    return TOLERANCE_STEPS;
+  }
+  // Near enough from the spacing, then exactly from the table
+  double ratio = tolerances[2] / tolerances[1];
+  int step = 1 + ceil( log( error / tolerances[1] ) / log( ratio ) );
+  step = ( step < 1 ) ? 1 : ( ( step > TOLERANCE_STEPS - 1 ) ? TOLERANCE_STEPS - 1 : step );
+  while( ( step > 1 ) && ( error <= tolerances[step - 1] ) )
+  {
+    step--;
+  }
+  while( error > tolerances[step] )
+  {
+    step++;
+  }
+  return step;
+}
+
+// ------------------------------------------------------------------------
+// Choose the columns for a block of rows, these must be in the current
+// band.  When only counting the points are added to the histograms
+// instead
+
+static void *select_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+
+  job->status = 0;
+  for( int y = job->first_row; y < job->last_row; y++ )
+  {
+    int candidates = row_errors( globe, job, y, band_row( globe->heights, y ) );
+    if( globe->row_columns == NULL )
+    {
+      int end = ( y == 0 ) || ( y == globe->ysize - 1 );
+      for( int k = 0; k < candidates; k++ )
+      {
+        int step = tolerance_step( globe, job->errors[k] );
+        job->histogram[step]++;
+        if( end )
+        {
+          job->end_histogram[step]++;
+        }
+      }
+      continue;
+    }
+    int count = 0;
+    for( int k = 0; k < candidates; k++ )
+    {
+      if( job->errors[k] > globe->tolerance )
+      {
+        job->kept[count++] = (int64_t)k * globe->xsize / candidates;
+      }
+    }
+    globe->row_counts[y] = count;
+    globe->row_columns[y] = malloc( count * sizeof( int ) );
+    if( globe->row_columns[y] == NULL )
+    {
+      job->status = -1;
+      return NULL;
+    }
+    memcpy( globe->row_columns[y], job->kept, count * sizeof( int ) );
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Unit normal from the slopes east and north.  east is the change in
+// radius across the point and the change in latitude from the row
+// below to the row above is split into the radii there
+
+static inline void surface_normal( double lat_cos, double lat_sin,
+                                   double west_cos, double west_sin, double west_radius,
+                                   double east_cos, double east_sin, double east_radius,
+                                   double lon_cos, double lon_sin,
+                                   double south_cos, double south_sin, double south_radius,
+                                   double north_cos, double north_sin, double north_radius,
+                                   float *nx, float *ny, float *nz )
+{
+  // Central differences of the surface position east to west and
+  // north to south
+  double ex = lat_cos * ( east_radius * east_cos - west_radius * west_cos );
+  double ey = lat_cos * ( east_radius * east_sin - west_radius * west_sin );
+  double ez = lat_sin * ( east_radius - west_radius );
+  double vertical = north_radius * north_cos - south_radius * south_cos;
+  double sx = lon_cos * vertical;
+  double sy = lon_sin * vertical;
+  double sz = north_radius * north_sin - south_radius * south_sin;
+  // East x north points outwards
+  double x = ey * sz - ez * sy;
+  double y = ez * sx - ex * sz;
+  double z = ex * sy - ey * sx;
+  double length = sqrt( x * x + y * y + z * z );
+  *nx = x / length;
+  *ny = y / length;
+  *nz = z / length;
+}
+
+// ------------------------------------------------------------------------
+// Terrain normals for a row, the rows either side must be in the band
+// or its halo.  Longitude wraps round and at the poles the row itself
+// is used in place of the missing one
+
+static void row_normals( const globe_t *globe, int y, double *radii, float *normals )
+{
+  int xsize = globe->xsize;
+  int south = ( y > 0 ) ? y - 1 : y;
+  int north = ( y < globe->ysize - 1 ) ? y + 1 : y;
+  double *radius = radii;
+  double *south_radius = radii + xsize;
+  double *north_radius = radii + 2 * xsize;
+  const int16_t *row = band_row( globe->heights, y );
+  const int16_t *south_row = band_row( globe->heights, south );
+  const int16_t *north_row = band_row( globe->heights, north );
+  const double *lon_cos = globe->lon_cos;
+  const double *lon_sin = globe->lon_sin;
+  double lat_cos = globe->lat_cos[y];
+  double lat_sin = globe->lat_sin[y];
+  double south_cos = globe->lat_cos[south];
+  double south_sin = globe->lat_sin[south];
+  double north_cos = globe->lat_cos[north];
+  double north_sin = globe->lat_sin[north];
+  float *nx = normals;
+  float *ny = normals + xsize;
+  float *nz = normals + 2 * xsize;
+
+  for( int x = 0; x < xsize; x++ )
+  {
+    radius[x] = globe->planet_radius + ( row[x] * globe->magnification );
+    south_radius[x] = globe->planet_radius + ( south_row[x] * globe->magnification );
+    north_radius[x] = globe->planet_radius + ( north_row[x] * globe->magnification );
+  }
+  // The ends of the row wrap round, the rest is a straight loop that
+  // gcc vectorises with the VECTOR_CFLAGS in the Makefile
+  int ends[2] = { 0, xsize - 1 };
+  for( int i = 0; i < 2; i++ )
+  {
+    int x = ends[i];
+    int west = ( x + xsize - 1 ) % xsize;
+    int east = ( x + 1 ) % xsize;
+    surface_normal( lat_cos, lat_sin,
+                    lon_cos[west], lon_sin[west], radius[west],
+                    lon_cos[east], lon_sin[east], radius[east],
+                    lon_cos[x], lon_sin[x],
+                    south_cos, south_sin, south_radius[x],
+                    north_cos, north_sin, north_radius[x],
+                    &nx[x], &ny[x], &nz[x] );
+  }
+  for( int x = 1; x < xsize - 1; x++ )
+  {
+    surface_normal( lat_cos, lat_sin,
+                    lon_cos[x - 1], lon_sin[x - 1], radius[x - 1],
+                    lon_cos[x + 1], lon_sin[x + 1], radius[x + 1],
+                    lon_cos[x], lon_sin[x],
+                    south_cos, south_sin, south_radius[x],
+                    north_cos, north_sin, north_radius[x],
+                    &nx[x], &ny[x], &nz[x] );
+  }
+}
+
+// ------------------------------------------------------------------------
+// Index of a vertex in the output.  Tiled meshes write the verticies
+// of each tile together so that the faces that use them are close by
+
+static int vertex_index( const globe_t *globe, int x, int y )
+{
+  if( !globe->tiled )
+  {
+    return x + ( y * globe->xsize );
+  }
+  int first_row = y - y % TILE_ROWS;
+  int first_column = x - x % TILE_COLUMNS;
+  int rows = globe->ysize - first_row;
+  int columns = globe->xsize - first_column;
+  if( rows > TILE_ROWS )
+  {
+    rows = TILE_ROWS;
+  }
+  if( columns > TILE_COLUMNS )
+  {
+    columns = TILE_COLUMNS;
+  }
+  return ( first_row * globe->xsize ) + ( first_column * rows ) +
+         ( ( y - first_row ) * columns ) + ( x - first_column );
+}
+
+// ------------------------------------------------------------------------
+// Add a vertex to the job's buffer, its row must be in the current band
+// and have been coloured
+
+static int put_vertex( job_t *job, int x, int y )
+{
+  const globe_t *globe = job->globe;
+  int16_t height = band_get( globe->heights, x, y );
+  double lat_cos = globe->lat_cos[y];
+  double lat_sin = globe->lat_sin[y];
+
+  // Convert to cartesian coordinates
+  int radius = globe->planet_radius + ( height * globe->magnification );
+  float xc = radius * lat_cos * globe->lon_cos[x];
+  float yc = radius * lat_cos * globe->lon_sin[x];
+  float zc = radius * lat_sin;
+  // Calculate normals, set to point outwards
+  float nxc, nyc, nzc;
+  if( globe->terrain_normals )
+  {
+    const float *normals = job->normals + (size_t)( y - job->first_row ) * 3 * globe->xsize;
+    nxc = normals[x];
+    nyc = normals[globe->xsize + x];
+    nzc = normals[2 * globe->xsize + x];
+  }
+  else
+  {
+    nxc = ( globe->planet_radius * 2 * lat_cos * globe->lon_cos[x] );
+    nyc = ( globe->planet_radius * 2 * lat_cos * globe->lon_sin[x] );
+    nzc = ( globe->planet_radius * 2 * lat_sin );
+  }
+  // Write values to buffer
+  uint32_t colour = job->colours[(size_t)( y - job->first_row ) * globe->xsize + x];
+  return ply_put_vertex( &job->buffer, xc, yc, zc,
+                         COLOUR_RED( colour ), COLOUR_GREEN( colour ), COLOUR_BLUE( colour ),
+                         nxc, nyc, nzc );
+}
+
+// ------------------------------------------------------------------------
+// Build the verticies for a block of rows, these must be in the
+// current band
+
+static void *vertex_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+  int xsize = globe->xsize;
+
+  job->status = 0;
+  // Colour the whole block in one go
+  for( int y = job->first_row; y < job->last_row; y++ )
+  {
+    job->invalid_count += colour_row( globe->colour, band_row( globe->heights, y ), band_row( globe->mask, y ),
+                                      xsize, job->colours + (size_t)( y - job->first_row ) * xsize );
+    if( globe->terrain_normals )
+    {
+      row_normals( globe, y, job->radii, job->normals + (size_t)( y - job->first_row ) * 3 * xsize );
+    }
+  }
+  if( globe->tiled )
+  {
+    // A job is a row of tiles, write them one after the other
+    for( int first_column = 0; first_column < xsize; first_column += TILE_COLUMNS )
+    {
+      int last_column = first_column + TILE_COLUMNS;
+      if( last_column > xsize )
+      {
+        last_column = xsize;
+      }
+      for( int y = job->first_row; y < job->last_row; y++ )
+      {
+        for( int x = first_column; x < last_column; x++ )
+        {
+          if( put_vertex( job, x, y ) != 0 )
+          {
+            job->status = -1;
+            return NULL;
+          }
+        }
+      }
+    }
+    return NULL;
+  }
+  for( int y = job->first_row; y < job->last_row; y++ )
+  {
+    // Loop through longitude values, an adaptive mesh only has some
+    // of them
+    const int *columns = globe->adaptive ? globe->row_columns[y] : NULL;
+    int count = globe->adaptive ? globe->row_counts[y] : xsize;
+    for( int i = 0; i < count; i++ )
+    {
+      if( put_vertex( job, ( columns != NULL ) ? columns[i] : i, y ) != 0 )
+      {
+        job->status = -1;
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Compress a block of rows for a compact file, these must be in the
+// current band
+
+static void *compact_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+  int rows = job->last_row - job->first_row;
+  const int16_t *mask = band_row( globe->mask, job->first_row );
+
+  job->status = 0;
+  for( size_t i = 0; i < (size_t)rows * globe->xsize; i++ )
+  {
+    if( (uint16_t)mask[i] >= COLOUR_CLASSES )
+    {
+      job->invalid_count++;
+    }
+  }
+  if( ( gmesh_encode_block( &job->writer, job->first_row, rows,
+                            band_row( globe->heights, job->first_row ), mask ) != 0 ) ||
+      ( ply_put_bytes( &job->buffer, job->writer.data, job->writer.size ) != 0 ) )
+  {
+    job->status = -1;
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Build the faces between a block of rows and the rows above them
+
+static void *face_worker( void *arg )
+{
+  job_t *job = arg;
+  int xsize = job->globe->xsize;
+
+  job->status = 0;
+  for( int y = job->first_row; y < job->last_row; y++ )
+  {
+    for( int x = 0; x < xsize - 1; x++ )
+    {
+      if( ply_put_face( &job->buffer,
+                        ( x + ( y * xsize ) ), // bottom left
+                        ( ( x + 1 ) + ( y * xsize ) ), // bottom right
+                        ( ( x + 1 ) + ( ( y + 1 ) * xsize ) ), // top right
+                        ( x + ( ( y + 1 ) * xsize ) ) // top left
+                      ) != 0 )
+      {
+        job->status = -1;
+        return NULL;
+      }
+    }
+    // Loop back to start
+    if( ply_put_face( &job->buffer,
+                      ( ( xsize - 1 ) + ( y * xsize ) ), // bottom left
+                      ( 0 + ( y * xsize ) ), // bottom right
+                      ( 0 + ( ( y + 1 ) * xsize ) ), // top right
+                      ( ( xsize - 1 ) + ( ( y + 1 ) * xsize ) ) // top left
+                    ) != 0 )
+    {
+      job->status = -1;
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Build the faces of a tiled mesh, a job is a row of tiles.  Each tile
+// is TILE_COLUMNS wide so that the verticies shared between one row of
+// faces and the next are still in the GPU's vertex cache.  Quads are
+// split into two triangles or written as a strip per row of the tile
+
+static void *tiled_face_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+  int xsize = globe->xsize;
+  int strips = ( job->buffer.faces == PLY_FACES_STRIPS );
+
+  job->status = 0;
+  for( int first_column = 0; first_column < xsize; first_column += TILE_COLUMNS )
+  {
+    int last_column = first_column + TILE_COLUMNS;
+    if( last_column > xsize )
+    {
+      last_column = xsize;
+    }
+    for( int y = job->first_row; y < job->last_row; y++ )
+    {
+      int status = 0;
+      for( int x = first_column; x < last_column; x++ )
+      {
+        // Loop back to start at the end of the row
+        int next = ( x + 1 ) % xsize;
+        int bottom_left = vertex_index( globe, x, y );
+        int bottom_right = vertex_index( globe, next, y );
+        int top_right = vertex_index( globe, next, y + 1 );
+        int top_left = vertex_index( globe, x, y + 1 );
+        if( strips )
+        {
+          // Top then bottom so that the triangles face the same way
+          // as the quads
+          if( x == first_column )
+          {
+            status |= ply_put_strip_index( &job->buffer, top_left );
+            status |= ply_put_strip_index( &job->buffer, bottom_left );
+          }
+          status |= ply_put_strip_index( &job->buffer, top_right );
+          status |= ply_put_strip_index( &job->buffer, bottom_right );
+        }
+        else
+        {
+          status |= ply_put_triangle( &job->buffer, bottom_left, bottom_right, top_right );
+          status |= ply_put_triangle( &job->buffer, bottom_left, top_right, top_left );
+        }
+      }
+      if( strips )
+      {
+        status |= ply_put_strip_index( &job->buffer, -1 );
+      }
+      if( status != 0 )
+      {
+        job->status = -1;
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Build the triangles between a block of adaptive rows and the rows
+// above them.  The two rows are zipped together in order of longitude,
+// each triangle moves one point along one of the rows
+
+static void *adaptive_face_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+
+  job->status = 0;
+  for( int y = job->first_row; y < job->last_row; y++ )
+  {
+    const int *bottom = globe->row_columns[y];
+    const int *top = globe->row_columns[y + 1];
+    int bottom_count = globe->row_counts[y];
+    int top_count = globe->row_counts[y + 1];
+    int bottom_first = globe->row_first[y];
+    int top_first = globe->row_first[y + 1];
+    int i = 0;
+    int j = 0;
+
+    while( ( i < bottom_count ) || ( j < top_count ) )
+    {
+      // Longitude of the next point along each row, the end of the
+      // row wraps round to column 0
+      int bottom_next = ( i + 1 < bottom_count ) ? bottom[i + 1] : globe->xsize;
+      int top_next = ( j + 1 < top_count ) ? top[j + 1] : globe->xsize;
+      int status;
+      if( ( j == top_count ) || ( ( i < bottom_count ) && ( bottom_next <= top_next ) ) )
+      {
+        status = ply_put_triangle( &job->buffer,
+                                   bottom_first + i % bottom_count,
+                                   bottom_first + ( i + 1 ) % bottom_count,
+                                   top_first + j % top_count );
+        i++;
+      }
+      else
+      {
+        status = ply_put_triangle( &job->buffer,
+                                   bottom_first + i % bottom_count,
+                                   top_first + ( j + 1 ) % top_count,
+                                   top_first + j % top_count );
+        j++;
+      }
+      if( status != 0 )
+      {
+        job->status = -1;
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Height and mask value in a direction from the centre of the globe.
+// Heights are interpolated between the four nearest values, the mask
+// is the nearest value
+
+static void sample_direction( const globe_t *globe, const double *direction,
+                              int16_t *height, int16_t *mask_value )
+{
+  int xsize = globe->xsize;
+  int ysize = globe->ysize;
+  double latitude = atan2( direction[2], hypot( direction[0], direction[1] ) ) * 180.0 / M_PI;
+  double longitude = atan2( direction[1], direction[0] ) * 180.0 / M_PI;
+  // Value i is at the centre of cell i
+  double fx = ( longitude + 180.0 ) * xsize / 360.0 - 0.5;
+  double fy = ( latitude + 90.0 ) * ysize / 180.0 - 0.5;
+  int x0 = floor( fx );
+  int y0 = floor( fy );
+  double tx = fx - x0;
+  double ty = fy - y0;
+  // Longitude wraps round, latitude stops at the poles
+  int x1 = ( x0 + 1 + xsize ) % xsize;
+  x0 = ( x0 + xsize ) % xsize;
+  int y1 = ( y0 + 1 < ysize ) ? y0 + 1 : ysize - 1;
+  y0 = ( y0 < 0 ) ? 0 : y0;
+  double bottom = binfile_get( globe->input_bin, x0, y0 ) * ( 1.0 - tx ) +
+                  binfile_get( globe->input_bin, x1, y0 ) * tx;
+  double top = binfile_get( globe->input_bin, x0, y1 ) * ( 1.0 - tx ) +
+               binfile_get( globe->input_bin, x1, y1 ) * tx;
+  *height = lrint( bottom * ( 1.0 - ty ) + top * ty );
+  *mask_value = binfile_get( globe->mask_bin, ( tx < 0.5 ) ? x0 : x1, ( ty < 0.5 ) ? y0 : y1 );
+}
+
+// ------------------------------------------------------------------------
+// Point on the model surface in a direction, which needn't be a unit
+// vector
+
+static void surface_point( const globe_t *globe, const double *direction, double *point )
+{
+  double length = sqrt( direction[0] * direction[0] + direction[1] * direction[1] +
+                        direction[2] * direction[2] );
+  double unit[3] = { direction[0] / length, direction[1] / length, direction[2] / length };
+  int16_t height;
+  int16_t mask_value;
+  sample_direction( globe, unit, &height, &mask_value );
+  int radius = globe->planet_radius + ( height * globe->magnification );
+  for( int k = 0; k < 3; k++ )
+  {
+    point[k] = radius * unit[k];
+  }
+}
+
+// ------------------------------------------------------------------------
+// Terrain normal of a cube sphere vertex from central differences one
+// input cell either side.  The directions used only depend on the
+// vertex direction, not its face, so repeated edge verticies get the
+// same normal
+
+static void cube_normal( const globe_t *globe, const double *direction, float *normal )
+{
+  // First tangent is east, or away from the x axis near the poles
+  double t1[3];
+  if( fabs( direction[2] ) < 0.9 )
+  {
+    t1[0] = -direction[1];
+    t1[1] = direction[0];
+    t1[2] = 0.0;
+  }
+  else
+  {
+    t1[0] = 0.0;
+    t1[1] = -direction[2];
+    t1[2] = direction[1];
+  }
+  double length = sqrt( t1[0] * t1[0] + t1[1] * t1[1] + t1[2] * t1[2] );
+  for( int k = 0; k < 3; k++ )
+  {
+    t1[k] /= length;
+  }
+  // Second tangent is direction x t1 so that t1 x t2 points outwards
+  double t2[3] = { direction[1] * t1[2] - direction[2] * t1[1],
+                   direction[2] * t1[0] - direction[0] * t1[2],
+                   direction[0] * t1[1] - direction[1] * t1[0] };
+  double step = M_PI / globe->ysize;
+  double d[3];
+  double p1[3], p2[3], p3[3], p4[3];
+  for( int k = 0; k < 3; k++ ) d[k] = direction[k] + step * t1[k];
+  surface_point( globe, d, p1 );
+  for( int k = 0; k < 3; k++ ) d[k] = direction[k] - step * t1[k];
+  surface_point( globe, d, p2 );
+  for( int k = 0; k < 3; k++ ) d[k] = direction[k] + step * t2[k];
+  surface_point( globe, d, p3 );
+  for( int k = 0; k < 3; k++ ) d[k] = direction[k] - step * t2[k];
+  surface_point( globe, d, p4 );
+  double a[3] = { p1[0] - p2[0], p1[1] - p2[1], p1[2] - p2[2] };
+  double b[3] = { p3[0] - p4[0], p3[1] - p4[1], p3[2] - p4[2] };
+  double n[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+  length = sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+  for( int k = 0; k < 3; k++ )
+  {
+    normal[k] = n[k] / length;
+  }
+}
+
+// ------------------------------------------------------------------------
+// Build the verticies of a cube sphere.  The rows of all of the faces
+// are numbered one after the other, each has cube size + 1 points
+
+static void *cube_vertex_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+  int points = globe->cube->size + 1;
+
+  job->status = 0;
+  for( int row = job->first_row; row < job->last_row; row++ )
+  {
+    int face = row / points;
+    int j = row % points;
+    for( int i = 0; i < points; i++ )
+    {
+      double direction[3];
+      int16_t height;
+      int16_t mask_value;
+      cube_direction( globe->cube, face, i, j, direction );
+      sample_direction( globe, direction, &height, &mask_value );
+      if( (uint16_t)mask_value >= COLOUR_CLASSES )
+      {
+        job->invalid_count++;
+      }
+      uint32_t colour = colour_get( globe->colour, height, mask_value );
+      int radius = globe->planet_radius + ( height * globe->magnification );
+      float normal[3];
+      if( globe->terrain_normals )
+      {
+        cube_normal( globe, direction, normal );
+      }
+      else
+      {
+        for( int k = 0; k < 3; k++ )
+        {
+          normal[k] = globe->planet_radius * 2 * direction[k];
+        }
+      }
+      if( ply_put_vertex( &job->buffer,
+                          radius * direction[0], radius * direction[1], radius * direction[2],
+                          COLOUR_RED( colour ), COLOUR_GREEN( colour ), COLOUR_BLUE( colour ),
+                          normal[0], normal[1], normal[2] ) != 0 )
+      {
+        job->status = -1;
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Build the faces of a cube sphere, each face has cube size rows of
+// quads.  The faces aren't joined, the points along their edges are
+// repeated exactly instead
+
+static void *cube_face_worker( void *arg )
+{
+  job_t *job = arg;
+  const globe_t *globe = job->globe;
+  int size = globe->cube->size;
+  int points = size + 1;
+
+  job->status = 0;
+  for( int row = job->first_row; row < job->last_row; row++ )
+  {
+    int face = row / size;
+    int j = row % size;
+    int first = ( face * points + j ) * points;
+    for( int i = 0; i < size; i++ )
+    {
+      int bottom_left = first + i;
+      int bottom_right = bottom_left + 1;
+      int top_right = bottom_right + points;
+      int top_left = bottom_left + points;
+      int status;
+      if( job->buffer.faces == PLY_FACES_UCHAR )
+      {
+        status = ply_put_triangle( &job->buffer, bottom_left, bottom_right, top_right ) |
+                 ply_put_triangle( &job->buffer, bottom_left, top_right, top_left );
+      }
+      else
+      {
+        status = ply_put_face( &job->buffer, bottom_left, bottom_right, top_right, top_left );
+      }
+      if( status != 0 )
+      {
+        job->status = -1;
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Split rows first_row to last_row - 1 into blocks, run the worker on
+// them using up to threads threads at a time and write the results out
+// in order.  The output is the same whatever the number of threads
+
+static int run_jobs( job_t *jobs, int threads, int first_row, int last_row,
+                     void *(*worker)( void * ), FILE *output_file, progress_t *progress )
+{
+  pthread_t ids[threads];
+
+  while( first_row < last_row )
+  {
+    int count = 0;
+    while( ( count < threads ) && ( first_row < last_row ) )
+    {
+      jobs[count].first_row = first_row;
+      first_row += JOB_ROWS;
+      if( first_row > last_row )
+      {
+        first_row = last_row;
+      }
+      jobs[count].last_row = first_row;
+      count++;
+    }
+    if( count == 1 )
+    {
+      // No need for another thread
+      worker( &jobs[0] );
+    }
+    else
+    {
+      for( int i = 0; i < count; i++ )
+      {
+        if( pthread_create( &ids[i], NULL, worker, &jobs[i] ) != 0 )
+        {
+          // Do this one here instead
+          ids[i] = pthread_self();
+          worker( &jobs[i] );
+        }
+      }
+      for( int i = 0; i < count; i++ )
+      {
+        if( !pthread_equal( ids[i], pthread_self() ) )
+        {
+          pthread_join( ids[i], NULL );
+        }
+      }
+    }
+    for( int i = 0; i < count; i++ )
+    {
+      size_t bytes = ( output_file != NULL ) ? jobs[i].buffer.used : 0;
+      if( ( jobs[i].status != 0 ) || ( ply_write_to( &jobs[i].buffer, output_file ) != 0 ) )
+      {
+        return -1;
+      }
+      progress_update( progress, jobs[i].last_row - jobs[i].first_row, 0, bytes );
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Choose the columns of every row of an adaptive mesh at the current
+// tolerance, returns the number of triangles or -1 on error.  If only
+// counting the histograms are filled in and 0 is returned
+
+static int64_t select_columns( globe_t *globe, job_t *jobs, int threads, progress_t *progress )
+{
+  for( int y = 0; y < globe->ysize; y += globe->heights->rows )
+  {
+    if( ( band_fetch( globe->heights, y, 0 ) != 0 ) ||
+        ( run_jobs( jobs, threads, y, globe->heights->first_row + globe->heights->rows,
+                    select_worker, NULL, progress ) != 0 ) )
+    {
+      return -1;
+    }
+  }
+  int64_t triangles = 0;
+  for( int y = 0; ( y < globe->ysize - 1 ) && ( globe->row_columns != NULL ); y++ )
+  {
+    triangles += globe->row_counts[y] + globe->row_counts[y + 1];
+  }
+  return triangles;
+}
+
+// ------------------------------------------------------------------------
+// Find the smallest of the tolerances tried that gives at most budget
+// triangles.  One pass counts the points that each tolerance would
+// keep, the points of each row are in the triangles above and below it
+// except in the top and bottom rows.  Returns the index of the
+// tolerance, the largest if none meet the budget, or -1 on error
+
+static int budget_tolerance( globe_t *globe, job_t *jobs, int threads, int64_t budget, progress_t *progress )
+{
+  int **columns = globe->row_columns;
+
+  for( int i = 0; i < threads; i++ )
+  {
+    memset( jobs[i].histogram, 0, ( TOLERANCE_STEPS + 1 ) * sizeof( int64_t ) );
+    memset( jobs[i].end_histogram, 0, ( TOLERANCE_STEPS + 1 ) * sizeof( int64_t ) );
+  }
+  globe->row_columns = NULL;
+  int64_t status = select_columns( globe, jobs, threads, progress );
+  globe->row_columns = columns;
+  if( status < 0 )
+  {
+    return -1;
+  }
+  // Down from the largest tolerance, adding the points each one keeps
+  int64_t triangles = 0;
+  int step;
+  for( step = TOLERANCE_STEPS - 1; step >= 0; step-- )
+  {
+    for( int i = 0; i < threads; i++ )
+    {
+      triangles += 2 * jobs[i].histogram[step + 1] - jobs[i].end_histogram[step + 1];
+    }
+    if( triangles > budget )
+    {
+      break;
+    }
+  }
+  return ( step < TOLERANCE_STEPS - 1 ) ? step + 1 : TOLERANCE_STEPS - 1;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: makeglobe [options] <input file> <mask file> <terrain LUT> <bathymetry LUT> <xsize> <planet radius> [magnification]\n" );
+  printf( "  ( output will be written to <input file>.ply )\n" );
+  printf( "  ( xsize can be 0 if the files have headers, which give the size )\n" );
+  printf( "  Options:\n" );
+  printf( "    -f format         ascii or binary PLY, or compact, default ascii.  Compact\n" );
+  printf( "                      files only hold the heights and are written to\n" );
+  printf( "                      <input file>.gmsh, mesh2ply turns them back into PLY\n" );
+  printf( "    -p grid|cube      mesh shape, a latitude/longitude grid or a cube sphere\n" );
+  printf( "                      with the same spacing at the equator, default grid\n" );
+  printf( "    -n                unit normals from the slope of the terrain, default\n" );
+  printf( "                      is to point straight out from the centre\n" );
+  printf( "    -m faces          quads, triangles or strips, default quads.  Triangles\n" );
+  printf( "                      and strips are ordered for the GPU vertex cache\n" );
+  printf( "    -b rows           rows of input held in memory, default %d\n", BAND_ROWS );
+  printf( "    -t threads        number of threads, default is one per CPU\n" );
+  printf( "    -a tolerance      adaptive mesh, points within tolerance of the mesh\n" );
+  printf( "                      are dropped, in model units\n" );
+  printf( "    -T triangles      adaptive mesh with the tolerance chosen to give at\n" );
+  printf( "                      most this many triangles.  Rows are never merged so\n" );
+  printf( "                      there are at least %d triangles per row\n", 2 * MIN_ROW_POINTS );
+  printf( "    -i seconds        print progress every this many seconds\n" );
+  printf( "    -J file           write the time taken by each stage to file as JSON\n" );
+}
+
+// ------------------------------------------------------------------------
 
 int main( int argc, char *argv[] )
 {
-  FILE* input_file;
-  FILE *mask_file;
   int xsize;
   int ysize;
   int planet_radius;
@@ -53,33 +1099,154 @@ int main( int argc, char *argv[] )
   FILE *bath_LUT_file;
   int magnification;
   char output_file_name[OUTPUT_FILE_NAME_SIZE];
+  ply_format_t format = PLY_ASCII;
+  ply_faces_t faces_type = PLY_FACES_INT;
+  int band_rows = BAND_ROWS;
+  int threads = sysconf( _SC_NPROCESSORS_ONLN );
+  int adaptive = 0;
+  int cube_mode = 0;
+  int terrain_normals = 0;
+  int compact = 0;
+  double tolerance = 0.0;
+  int64_t triangle_budget = 0;
+  double progress_interval = 0.0;
+  char *timing_file_name = NULL;
+  int opt;
 
-  printf( "makeglobe, v0.1\n" );
+  printf( "makeglobe, v0.2\n" );
+  if( threads < 1 )
+  {
+    threads = 1;
+  }
 
-  // Check command line
-  if( ( argc != 7 ) && ( argc != 8 ) )
+  // Check options
+  while( ( opt = getopt( argc, argv, "+f:p:nm:b:t:a:T:i:J:" ) ) != -1 )
   {
-    printf( "ERROR: usage is: makeglobe <input file> <mask file> <terrain LUT> <bathymetry LUT> <xsize> <planet radius> [magnification]\n" );
-    printf( "  ( output will be written to <input file>.ply )\n" );
+    switch( opt )
+    {
+      case 'f':
+        if( strcmp( optarg, "compact" ) == 0 )
+        {
+          compact = 1;
+        }
+        else if( ply_format_from_name( optarg, &format ) != 0 )
+        {
+          printf( "ERROR: invalid output format: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'p':
+        if( strcmp( optarg, "cube" ) == 0 )
+        {
+          cube_mode = 1;
+        }
+        else if( strcmp( optarg, "grid" ) != 0 )
+        {
+          printf( "ERROR: invalid mesh shape: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'n':
+        terrain_normals = 1;
+        break;
+      case 'm':
+        if( ply_faces_from_name( optarg, &faces_type ) != 0 )
+        {
+          printf( "ERROR: invalid faces: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'b':
+        band_rows = atoi( optarg );
+        if( band_rows < 1 )
+        {
+          printf( "ERROR: invalid band size: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 't':
+        threads = atoi( optarg );
+        if( threads < 1 )
+        {
+          printf( "ERROR: invalid number of threads: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'a':
+        adaptive = 1;
+        tolerance = atof( optarg );
+        if( tolerance < 0 )
+        {
+          printf( "ERROR: invalid tolerance: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'T':
+        adaptive = 1;
+        triangle_budget = atoll( optarg );
+        if( triangle_budget < 1 )
+        {
+          printf( "ERROR: invalid number of triangles: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'i':
+        progress_interval = atof( optarg );
+        if( progress_interval <= 0.0 )
+        {
+          printf( "ERROR: invalid progress interval: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'J':
+        timing_file_name = optarg;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Adaptive meshes are always triangles and can't be tiled
+  if( adaptive && ( faces_type == PLY_FACES_STRIPS ) )
+  {
+    printf( "ERROR: strips can't be used with an adaptive mesh\n" );
+    return EXIT_FAILURE;
+  }
+  if( cube_mode && ( adaptive || ( faces_type == PLY_FACES_STRIPS ) ) )
+  {
+    printf( "ERROR: a cube sphere can only be written as quads or triangles\n" );
     return EXIT_FAILURE;
   }
-  // Check input files
-  input_file = fopen( argv[1], "r" );
-  if( input_file == NULL )
+  // Compact files can only hold a plain grid, everything else is
+  // worked out again from the heights
+  if( compact && ( adaptive || cube_mode || terrain_normals || ( faces_type != PLY_FACES_INT ) ) )
   {
-    printf( "ERROR: could not open input file: %s\n", argv[1] );
+    printf( "ERROR: compact output is only for a grid of quads with the default normals\n" );
     return EXIT_FAILURE;
   }
-  mask_file = fopen( argv[2], "r" );
-  if( mask_file == NULL )
+  // Tiles and compact blocks are made one job at a time and a job's
+  // rows must all be in the same band
+  if( ( ( faces_type != PLY_FACES_INT ) && !adaptive ) || compact )
+  {
+    band_rows = ( ( band_rows + JOB_ROWS - 1 ) / JOB_ROWS ) * JOB_ROWS;
+  }
+  // Skip over the options so that the positional arguments are
+  // numbered as before
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( ( argc != 7 ) && ( argc != 8 ) )
   {
-    printf( "ERROR: could not open mask file: %s\n", argv[1] );
+    usage();
     return EXIT_FAILURE;
   }
+  progress_t progress;
+  progress_init( &progress, "makeglobe", progress_interval );
   // Check output file
   // Create output file name
-  snprintf( output_file_name, OUTPUT_FILE_NAME_SIZE, "%s.ply", argv[1] );
-  output_file = fopen( output_file_name, "w" );
+  snprintf( output_file_name, OUTPUT_FILE_NAME_SIZE, compact ? "%s.gmsh" : "%s.ply", argv[1] );
+  output_file = fopen( output_file_name, "wb" );
   if( output_file == NULL )
   {
     printf( "ERROR: could not open output file: %s\n", output_file_name );
@@ -98,12 +1265,12 @@ int main( int argc, char *argv[] )
   // Read bathymetry LUT
   if( bath_LUT_file == NULL )
   {
-    printf( "ERROR: could not open bathymetry LUT file: %s\n", argv[3] );
+    printf( "ERROR: could not open bathymetry LUT file: %s\n", argv[4] );
     return EXIT_FAILURE;
   }
   // Check xsize factor
   xsize = atoi( argv[5] );
-  if( ( xsize < 1 ) || ( xsize > SIZE_X ) || ( xsize % 2 != 0 ) )
+  if( xsize < 0 )
   {
     printf( "ERROR: invalid X size: %s\n", argv[5] );
     return EXIT_FAILURE;
@@ -133,279 +1300,418 @@ int main( int argc, char *argv[] )
   }
   printf( "Magnification = %d\n", magnification );
 
-  // Set ysize
-  ysize = xsize / 2;
+  // Map the input and mask files
+  binfile_t input_bin;
+  binfile_t mask_bin;
+  int status = binfile_open( &input_bin, argv[1], xsize, xsize / 2 );
+  if( status != BINFILE_OK )
+  {
+    printf( "ERROR: could not read input file: %s, %s\n", argv[1], binfile_error( status ) );
+    return EXIT_FAILURE;
+  }
+  // A header gives the size of the grid, which needn't be 2:1.  Files
+  // without one are xsize by xsize / 2
+  if( ( xsize != 0 ) && ( input_bin.width != xsize ) )
+  {
+    printf( "ERROR: input file is %d x %d, not %d wide\n", input_bin.width, input_bin.height, xsize );
+    return EXIT_FAILURE;
+  }
+  xsize = input_bin.width;
+  ysize = input_bin.height;
+  status = binfile_open( &mask_bin, argv[2], xsize, ysize );
+  if( status != BINFILE_OK )
+  {
+    printf( "ERROR: could not read mask file: %s, %s\n", argv[2], binfile_error( status ) );
+    return EXIT_FAILURE;
+  }
+  if( ( mask_bin.width != xsize ) || ( mask_bin.height != ysize ) )
+  {
+    printf( "ERROR: mask file is not %d x %d\n", xsize, ysize );
+    return EXIT_FAILURE;
+  }
+  // Faces index the verticies with PLY ints
+  int64_t cube_points = ( xsize >= 8 ) ? xsize / 4 + 1 : 3;
+  int64_t mesh_points = cube_mode ? CUBE_FACES * cube_points * cube_points : (int64_t)xsize * ysize;
+  if( mesh_points > INT32_MAX )
+  {
+    printf( "ERROR: %d x %d grid gives %lld verticies, more than a PLY file can index (%d)\n",
+            xsize, ysize, (long long)mesh_points, INT32_MAX );
+    return EXIT_FAILURE;
+  }
+  // The files are converted a band of rows at a time so that memory
+  // use doesn't depend on the size of the globe
+  band_t heights;
+  band_t mask;
+  // Terrain normals need the rows either side of each one
+  if( ( band_open_halo( &heights, &input_bin, band_rows, terrain_normals ? 1 : 0 ) != 0 ) ||
+      ( band_open( &mask, &mask_bin, band_rows ) != 0 ) )
+  {
+    printf( "ERROR: could not allocate input buffers\n" );
+    return EXIT_FAILURE;
+  }
+  // The range for shading comes from the header if there is one,
+  // otherwise the file is scanned
+  printf( "Reading input file...\n" );
+  progress_stage( &progress, "range", ysize );
+  if( !input_bin.has_range )
+  {
+    progress_update( &progress, ysize, (int64_t)xsize * ysize * 2, 0 );
+  }
+  binfile_min_max( &input_bin, &min_height, &max_height );
+  // Shading always starts from sea level
+  if( max_height < 0 )
+  {
+    max_height = 0;
+  }
+  if( min_height > 0 )
+  {
+    min_height = 0;
+  }
+  printf( "%lld values read\n", (long long)xsize * ysize );
+  printf( "  min: %d, max: %d\n", min_height, max_height );
+  progress_stage( &progress, "setup", 0 );
 
-  // Create output file name
-  snprintf( output_file_name, OUTPUT_FILE_NAME_SIZE, "%s.ply", argv[1] );
+  // Read the LUTs and work out the colour of every height
+  colour_t colour;
+  colour_init( &colour );
+  if( colour_read_lut( terrain_LUT_file, &colour.land_gradient, &colour.land_rows ) != 0 )
+  {
+    printf( "ERROR: invalid terrain LUT file: %s\n", argv[3] );
+    return EXIT_FAILURE;
+  }
+  if( colour_read_lut( bath_LUT_file, &colour.sea_gradient, &colour.sea_rows ) != 0 )
+  {
+    printf( "ERROR: invalid bathymetry LUT file: %s\n", argv[4] );
+    return EXIT_FAILURE;
+  }
+  fclose( terrain_LUT_file );
+  fclose( bath_LUT_file );
+  if( colour_build_table( &colour, min_height, max_height ) != 0 )
+  {
+    printf( "ERROR: could not allocate colour table\n" );
+    return EXIT_FAILURE;
+  }
 
-  // Read input file into Array
-  int count = 0;
-  int c1, c2;
-  int16_t spot_height;
-  max_height = 0;
-  min_height = 0;
-  printf( "Reading input file...\n" );
+  // Write model
+  globe_t globe;
+  globe.xsize = xsize;
+  globe.ysize = ysize;
+  globe.planet_radius = planet_radius;
+  globe.magnification = magnification;
+  globe.heights = &heights;
+  globe.mask = &mask;
+  globe.colour = &colour;
+  globe.tiled = ( faces_type != PLY_FACES_INT ) && !adaptive && !cube_mode;
+  globe.terrain_normals = terrain_normals;
+  globe.input_bin = &input_bin;
+  globe.mask_bin = &mask_bin;
+  globe.cube = NULL;
+  globe.adaptive = adaptive;
+  globe.tolerance = tolerance;
+  globe.row_counts = NULL;
+  globe.row_columns = NULL;
+  globe.row_first = NULL;
+  globe.tolerances = NULL;
+  // Tables of sin/cos values so that they are only calculated once
+  globe.lat_cos = malloc( ysize * sizeof( double ) );
+  globe.lat_sin = malloc( ysize * sizeof( double ) );
+  globe.lon_cos = malloc( xsize * sizeof( double ) );
+  globe.lon_sin = malloc( xsize * sizeof( double ) );
+  if( ( globe.lat_cos == NULL ) || ( globe.lat_sin == NULL ) ||
+      ( globe.lon_cos == NULL ) || ( globe.lon_sin == NULL ) )
+  {
+    printf( "ERROR: could not allocate sin/cos tables\n" );
+    return EXIT_FAILURE;
+  }
   for( int y = 0; y < ysize; y++ )
   {
-    for( int x = 0; x < xsize; x++ )
+    float latitude = -90.0 + ( 180.0 / (float)ysize / 2 ) + ( (float)y * 180.0 ) / (float)ysize;
+    globe.lat_cos[y] = cos( latitude * M_PI / 180.0 );
+    globe.lat_sin[y] = sin( latitude * M_PI / 180.0 );
+  }
+  for( int x = 0; x < xsize; x++ )
+  {
+    // Calculate longitude value
+    float longitude = -180.0 + ( 360.0 / (float)xsize / 2 ) + ( (float)x * 360.0 ) / (float)xsize;
+    globe.lon_cos[x] = cos( longitude * M_PI / 180.0 );
+    globe.lon_sin[x] = sin( longitude * M_PI / 180.0 );
+  }
+  // One output buffer per thread
+  job_t jobs[threads];
+  for( int i = 0; i < threads; i++ )
+  {
+    jobs[i].globe = &globe;
+    jobs[i].invalid_count = 0;
+    jobs[i].colours = malloc( (size_t)xsize * JOB_ROWS * sizeof( uint32_t ) );
+    jobs[i].normals = NULL;
+    jobs[i].radii = NULL;
+    if( terrain_normals )
     {
-      // Read two characters and store
-      c1 = fgetc( input_file );
-      if( c1 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 1\n" );
-        return EXIT_FAILURE;
-      }
-      c2 = fgetc( input_file );
-      if( c2 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 2\n" );
-        return EXIT_FAILURE;
-      }
-      spot_height = ( c1 << 8 ) + c2;
-      if( spot_height > max_height )
-      {
-        max_height = spot_height;
-      }
-      if( spot_height < min_height )
-      {
-        min_height = spot_height;
-      }
-      original[x][y] = spot_height;
-      count++;
+      jobs[i].normals = malloc( (size_t)xsize * JOB_ROWS * 3 * sizeof( float ) );
+      jobs[i].radii = malloc( (size_t)xsize * 3 * sizeof( double ) );
+    }
+    jobs[i].kept = NULL;
+    jobs[i].points = NULL;
+    jobs[i].errors = NULL;
+    jobs[i].runs = NULL;
+    jobs[i].histogram = NULL;
+    jobs[i].end_histogram = NULL;
+    if( adaptive )
+    {
+      jobs[i].kept = malloc( xsize * sizeof( int ) );
+      jobs[i].points = malloc( ( xsize + 1 ) * 3 * sizeof( double ) );
+      jobs[i].errors = malloc( xsize * sizeof( double ) );
+      jobs[i].runs = malloc( xsize * sizeof( run_t ) );
+      jobs[i].histogram = malloc( ( TOLERANCE_STEPS + 1 ) * sizeof( int64_t ) );
+      jobs[i].end_histogram = malloc( ( TOLERANCE_STEPS + 1 ) * sizeof( int64_t ) );
+    }
+    if( compact && ( gmesh_writer_init( &jobs[i].writer, xsize, JOB_ROWS, GMESH_LEVEL ) != 0 ) )
+    {
+      printf( "ERROR: could not allocate output buffer\n" );
+      return EXIT_FAILURE;
+    }
+    if( ( jobs[i].colours == NULL ) ||
+        ( terrain_normals && ( ( jobs[i].normals == NULL ) || ( jobs[i].radii == NULL ) ) ) ||
+        ( adaptive && ( ( jobs[i].kept == NULL ) || ( jobs[i].points == NULL ) ||
+                        ( jobs[i].errors == NULL ) || ( jobs[i].runs == NULL ) ||
+                        ( jobs[i].histogram == NULL ) || ( jobs[i].end_histogram == NULL ) ) ) ||
+        ( ply_buffer_init( &jobs[i].buffer, NULL, format, faces_type, PLY_BUFFER_SIZE ) != 0 ) )
+    {
+      printf( "ERROR: could not allocate output buffer\n" );
+      return EXIT_FAILURE;
     }
   }
-  printf( "%d values read\n", count );
-  printf( "  min: %d, max: %d\n", min_height, max_height );
-  // Read mask file into Array
-  printf( "Reading mask file...\n" );
-  count = 0;
-  for( int y = 0; y < ysize; y++ )
+
+  // Work out the size of the mesh
+  int64_t vertices = (int64_t)xsize * ysize;
+  int64_t faces = (int64_t)xsize * ( ysize - 1 );
+  cube_t cube;
+  if( cube_mode )
   {
-    for( int x = 0; x < xsize; x++ )
+    // A quarter of the equator on each face gives the same spacing
+    // there as the grid
+    if( cube_init( &cube, ( xsize >= 8 ) ? xsize / 4 : 2 ) != 0 )
     {
-      // Read two characters and store
-      c1 = fgetc( mask_file );
-      if( c1 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 1\n" );
-        return EXIT_FAILURE;
-      }
-      c2 = fgetc( mask_file );
-      if( c2 == EOF )
+      printf( "ERROR: could not allocate cube tables\n" );
+      return EXIT_FAILURE;
+    }
+    globe.cube = &cube;
+    vertices = CUBE_FACES * (int64_t)( cube.size + 1 ) * ( cube.size + 1 );
+    faces = CUBE_FACES * (int64_t)cube.size * cube.size;
+    printf( "Cube sphere, %d x %d points per face\n", cube.size + 1, cube.size + 1 );
+  }
+  if( globe.tiled || ( cube_mode && ( faces_type == PLY_FACES_UCHAR ) ) )
+  {
+    // Two triangles per quad
+    faces *= 2;
+  }
+  // Choose the points of an adaptive mesh
+  if( adaptive )
+  {
+    globe.row_counts = malloc( ysize * sizeof( int ) );
+    globe.row_first = malloc( ysize * sizeof( int ) );
+    globe.row_columns = calloc( ysize, sizeof( int * ) );
+    globe.tolerances = malloc( TOLERANCE_STEPS * sizeof( double ) );
+    if( ( globe.row_counts == NULL ) || ( globe.row_first == NULL ) || ( globe.row_columns == NULL ) ||
+        ( globe.tolerances == NULL ) )
+    {
+      printf( "ERROR: could not allocate mesh tables\n" );
+      return EXIT_FAILURE;
+    }
+    globe.tolerances[0] = 0.0;
+    for( int i = 1; i < TOLERANCE_STEPS; i++ )
+    {
+      globe.tolerances[i] = planet_radius * TOLERANCE_MIN *
+                            pow( TOLERANCE_MAX / TOLERANCE_MIN, (double)( i - 1 ) / ( TOLERANCE_STEPS - 2 ) );
+    }
+    printf( "Choosing mesh points\n" );
+    progress_stage( &progress, "select", 0 );
+    if( triangle_budget > 0 )
+    {
+      int step = budget_tolerance( &globe, jobs, threads, triangle_budget, &progress );
+      if( step < 0 )
       {
-        printf( "ERROR: unexpected EOF reached while reading 2\n" );
+        printf( "ERROR: could not choose mesh points\n" );
         return EXIT_FAILURE;
       }
-      mask[x][y] = ( c1 << 8 ) + c2;
-      count++;
+      globe.tolerance = globe.tolerances[step];
+    }
+    faces = select_columns( &globe, jobs, threads, &progress );
+    if( faces < 0 )
+    {
+      printf( "ERROR: could not choose mesh points\n" );
+      return EXIT_FAILURE;
+    }
+    vertices = 0;
+    for( int y = 0; y < ysize; y++ )
+    {
+      globe.row_first[y] = vertices;
+      vertices += globe.row_counts[y];
     }
+    if( ( triangle_budget > 0 ) && ( faces > triangle_budget ) )
+    {
+      printf( "WARNING: can't get below %lld triangles\n", (long long)faces );
+    }
+    printf( "  Tolerance %g, %lld verticies, %lld triangles\n", globe.tolerance, (long long)vertices,
+            (long long)faces );
   }
-  printf( "%d values read\n", count );
 
-  // Read terrain LUT into array
-  unsigned char channel[LAND_ROWS];
-  // Read red channel
-  if( fread( channel, LAND_ROWS, 1, terrain_LUT_file ) != 1 )
+  // Write 3D model to file
+  printf( "Writing 3D file\n" );
+  printf( "  Using %d thread(s)\n", threads );
+  if( compact )
   {
-    printf( "ERROR: unexpected EOF reached while reading terrain LUT red channel\n" );
-    return EXIT_FAILURE;
+    // Just the heights and the mask, a block of rows at a time
+    gmesh_info_t info;
+    info.xsize = xsize;
+    info.ysize = ysize;
+    info.planet_radius = planet_radius;
+    info.magnification = magnification;
+    info.min_height = min_height;
+    info.max_height = max_height;
+    info.land_gradient = colour.land_gradient;
+    info.land_rows = colour.land_rows;
+    info.sea_gradient = colour.sea_gradient;
+    info.sea_rows = colour.sea_rows;
+    if( gmesh_write_header( output_file, &info ) != 0 )
+    {
+      printf( "ERROR: failed to write output file: %s\n", output_file_name );
+      return EXIT_FAILURE;
+    }
+    printf( "  Writing heights ...\n");
+    progress_stage( &progress, "heights", ysize );
   }
-  for( int x = 0; x < LAND_ROWS; x++ )
+  else
   {
-    land_gradient[x][0] = channel[x];
+    // Write PLY header information
+    ply_write_header( output_file, format, faces_type, vertices, faces );
+    printf( "  Writing verticies ...\n");
+    progress_stage( &progress, "vertices", cube_mode ? CUBE_FACES * ( cube.size + 1 ) : ysize );
   }
-  // Read green channel
-  if( fread( channel, LAND_ROWS, 1, terrain_LUT_file ) != 1 )
+
+  // First write the verticies, a band at a time
+  if( cube_mode &&
+      ( run_jobs( jobs, threads, 0, CUBE_FACES * ( cube.size + 1 ), cube_vertex_worker, output_file, &progress ) != 0 ) )
   {
-    printf( "ERROR: unexpected EOF reached while reading terrain LUT green channel\n" );
+    printf( "ERROR: failed to write output file: %s\n", output_file_name );
     return EXIT_FAILURE;
   }
-  for( int x = 0; x < LAND_ROWS; x++ )
+  for( int y = 0; ( y < ysize ) && !cube_mode; y += heights.rows )
   {
-    land_gradient[x][1] = channel[x];
+    if( ( band_fetch( &heights, y, 0 ) != 0 ) || ( band_fetch( &mask, y, 0 ) != 0 ) )
+    {
+      printf( "ERROR: unexpected EOF reached while reading input files\n" );
+      return EXIT_FAILURE;
+    }
+    // Heights and mask values
+    progress_update( &progress, 0, (int64_t)heights.rows * xsize * 4, 0 );
+    if( run_jobs( jobs, threads, y, heights.first_row + heights.rows,
+                  compact ? compact_worker : vertex_worker, output_file, &progress ) != 0 )
+    {
+      printf( "ERROR: failed to write output file: %s\n", output_file_name );
+      return EXIT_FAILURE;
+    }
   }
-  // Read blue channel
-  if( fread( channel, LAND_ROWS, 1, terrain_LUT_file ) != 1 )
+
+  // Report bad mask values once rather than for every point
+  int invalid_count = 0;
+  for( int i = 0; i < threads; i++ )
   {
-    printf( "ERROR: unexpected EOF reached while reading terrain LUT blue channel\n" );
-    return EXIT_FAILURE;
+    invalid_count += jobs[i].invalid_count;
   }
-  for( int x = 0; x < LAND_ROWS; x++ )
+  if( invalid_count > 0 )
   {
-    land_gradient[x][2] = channel[x];
+    printf( "ERROR: %d invalid mask values found, set to 0,0,0\n", invalid_count );
   }
 
-  // Read bathymetry LUT into array
-  unsigned char sea_channel[SEA_ROWS];
-  // Read red channel
-  if( fread( sea_channel, SEA_ROWS, 1, bath_LUT_file ) != 1 )
+  // Then the faces, which a compact file doesn't need
+  if( !compact )
   {
-    printf( "ERROR: unexpected EOF reached while reading bath LUT red channel\n" );
-    return EXIT_FAILURE;
+    printf( "  Writing faces ...\n");
   }
-  for( int x = 0; x < SEA_ROWS; x++ )
+  void *(*worker)( void * ) = face_worker;
+  int face_rows = ysize - 1;
+  if( cube_mode )
   {
-    sea_gradient[x][0] = sea_channel[x];
+    worker = cube_face_worker;
+    face_rows = CUBE_FACES * cube.size;
   }
-  // Read green channel
-  if( fread( sea_channel, SEA_ROWS, 1, bath_LUT_file ) != 1 )
+  else if( adaptive )
   {
-    printf( "ERROR: unexpected EOF reached while reading bath LUT green channel\n" );
-    return EXIT_FAILURE;
+    worker = adaptive_face_worker;
   }
-  for( int x = 0; x < SEA_ROWS; x++ )
+  else if( globe.tiled )
   {
-    sea_gradient[x][1] = sea_channel[x];
+    worker = tiled_face_worker;
   }
-  // Read blue channel
-  if( fread( sea_channel, SEA_ROWS, 1, bath_LUT_file ) != 1 )
+  if( !compact )
   {
-    printf( "ERROR: unexpected EOF reached while reading bath LUT blue channel\n" );
-    return EXIT_FAILURE;
+    progress_stage( &progress, "faces", face_rows );
   }
-  for( int x = 0; x < SEA_ROWS; x++ )
+  // Strips are one list, each row of each tile has two indices per
+  // column, plus two to start the strip and one to end it
+  int64_t strip_indices = (int64_t)( 2 * xsize + 3 * ( ( xsize + TILE_COLUMNS - 1 ) / TILE_COLUMNS ) ) * ( ysize - 1 );
+  if( ( ( faces_type == PLY_FACES_STRIPS ) && ( ply_write_strip_start( output_file, format, strip_indices ) != 0 ) ) ||
+      ( !compact && ( run_jobs( jobs, threads, 0, face_rows, worker, output_file, &progress ) != 0 ) ) ||
+      ( ( faces_type == PLY_FACES_STRIPS ) && ( ply_write_strip_end( output_file, format ) != 0 ) ) )
   {
-    sea_gradient[x][2] = sea_channel[x];
+    printf( "ERROR: failed to write output file: %s\n", output_file_name );
+    return EXIT_FAILURE;
   }
 
-  // Write model
-  // Steps for shading
-  float land_step = (float) max_height / (float) LAND_ROWS;
-  float sea_step = (float) -min_height / (float) SEA_ROWS;
-
-  // Write 3D model to file
-  printf( "Writing 3D file\n" );
-  // Write PLY header information
-  fprintf( output_file, "ply\n" );
-  fprintf( output_file, "format ascii 1.0\n" );
-  fprintf( output_file, "comment created by makeglobe\n" );
-  fprintf( output_file, "element vertex %d\n", xsize * ysize );
-  fprintf( output_file, "property float x\n" );
-  fprintf( output_file, "property float y\n" );
-  fprintf( output_file, "property float z\n" );
-  fprintf( output_file, "property uchar red\n" );
-  fprintf( output_file, "property uchar green\n" );
-  fprintf( output_file, "property uchar blue\n" );
-  fprintf( output_file, "property float nx\n" );
-  fprintf( output_file, "property float ny\n" );
-  fprintf( output_file, "property float nz\n" );
-  fprintf( output_file, "element face %d\n", xsize * ( ysize-1 ) );
-  fprintf( output_file, "property list int int vertex_index\n" );
-  fprintf( output_file, "end_header\n" );
-
-  // First write the verticies
-  printf( "  Writing verticies ...\n");
-  for( int y = 0; y < ysize; y++ )
+  for( int i = 0; i < threads; i++ )
   {
-    float latitude = -90.0 + ( 180.0 / (float)ysize / 2 ) + ( (float)y * 180.0 ) / (float)ysize;
-    //printf( "Lat: %.6f, Step: %.6f, Count: %d\n", latitude, step, (int)(xsize/step) );
-
-    // Loop through longitude values
-    for( int x = 0; x < xsize; x++ )
-    {
-      // Calculate longitude value
-      // See note above about correction factor
-      float longitude = -180.0 + ( 360.0 / (float)xsize / 2 ) + ( (float)x * 360.0 ) / (float)xsize;
-      //printf( "%.6f|", longitude );
-      // Convert to cartesian coordinates
-      float xc = ( planet_radius + ( original[(int)x][y] * magnification ) ) * cos( latitude * M_PI / 180.0 ) * cos( longitude * M_PI / 180.0 );
-      float yc = ( planet_radius + ( original[(int)x][y] * magnification ) ) * cos( latitude * M_PI / 180.0 ) * sin( longitude * M_PI / 180.0 );
-      float zc = ( planet_radius + ( original[(int)x][y] * magnification ) ) * sin( latitude * M_PI / 180.0 );
-      // Calculate normals, set to point outwards
-      float nxc = ( planet_radius * 2 * cos( latitude * M_PI / 180.0 ) * cos( longitude * M_PI / 180.0) );
-      float nyc = ( planet_radius * 2 * cos( latitude * M_PI / 180.0 ) * sin( longitude * M_PI / 180.0) );
-      float nzc = ( planet_radius * 2 * sin( latitude * M_PI / 180.0 ) );
-      // Get colours
-      int r, g, b;
-      int idx;
-      // Process mask
-      // http://ddfe.curtin.edu.au/models/Earth2014/readme_earth2014.dat
-      // 0 - land topography above mean sea level (MSL)
-      // 1 - land topography below MSL
-      // 2 - ocean bathymetry
-      // 3 - inland lake, bedrock above MSL
-      // 4 - inland lake, bedrock below MSL
-      // 5 - ice cover, bedrock above MSL
-      // 6 - ice cover, bedrock below MSL
-      // 7 - ice shelf
-      // 8 - ice covered lake (Vostok)
-      switch( mask[(int)x][y] )
-      {
-        case 0:
-        case 1:
-          if( original[(int)x][y] < 0 )
-          {
-            idx = 0;
-          }
-          else
-          {
-            idx = (float) original[(int)x][y] / land_step;
-          }
-          r = land_gradient[idx][0];
-          g = land_gradient[idx][1];
-          b = land_gradient[idx][2];
-          break;
-        case 2:
-        case 3:
-        case 4:
-          if( original[(int)x][y] > 0 )
-          {
-            idx = 0;
-          }
-          else
-          {
-            idx = (float) -original[(int)x][y] / sea_step;
-          }
-          r = sea_gradient[SEA_ROWS - 1 - idx][0];
-          g = sea_gradient[SEA_ROWS - 1 - idx][1];
-          b = sea_gradient[SEA_ROWS - 1 - idx][2];
-          break;
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-          r = 255;
-          g = 255;
-          b = 255;
-          break;
-        default:
-          printf( "ERROR: Invalid mask value found, setting to 0,0,0\n" );
-          r = 0;
-          g = 0;
-          b = 0;
-          break;
-      }
-      // Write values to ply file
-      fprintf( output_file, "%.6f %.6f %.6f %d %d %d %.6f %.6f %.6f\n", xc, yc, zc, r, g, b, nxc, nyc, nzc );
+    ply_buffer_free( &jobs[i].buffer );
+    free( jobs[i].colours );
+    free( jobs[i].normals );
+    free( jobs[i].radii );
+    free( jobs[i].kept );
+    free( jobs[i].points );
+    free( jobs[i].errors );
+    free( jobs[i].runs );
+    free( jobs[i].histogram );
+    free( jobs[i].end_histogram );
+    if( compact )
+    {
+      gmesh_writer_free( &jobs[i].writer );
     }
-    //printf( "\n" );
   }
-
-  // Then the faces
-  printf( "  Writing faces ...\n");
-  for( int y = 0; y < ysize - 1; y++ )
+  if( adaptive )
   {
-    for( int x = 0; x < xsize - 1; x++ )
+    for( int y = 0; y < ysize; y++ )
     {
-      fprintf( output_file, "4 %d %d %d %d\n",
-                            ( x + ( y * xsize ) ), // bottom left
-                            ( ( x + 1 ) + ( y * xsize ) ), // bottom right
-                            ( ( x + 1 ) + ( ( y + 1 ) * xsize ) ), // top right
-                            ( x + ( ( y + 1 ) * xsize ) ) // top left
-                          );
+      free( globe.row_columns[y] );
     }
-    // Loop back to start
-    fprintf( output_file, "4 %d %d %d %d\n",
-                          ( ( xsize - 1 ) + ( y * xsize ) ), // bottom left
-                          ( 0 + ( y * xsize ) ), // bottom right
-                          ( 0 + ( ( y + 1 ) * xsize ) ), // top right
-                          ( ( xsize - 1 ) + ( ( y + 1 ) * xsize ) ) // top left
-                        );
-
   }
-
-  fclose( output_file );
+  free( globe.row_counts );
+  free( globe.row_columns );
+  free( globe.row_first );
+  free( globe.tolerances );
+  if( cube_mode )
+  {
+    cube_free( &cube );
+  }
+  colour_free( &colour );
+  free( globe.lat_cos );
+  free( globe.lat_sin );
+  free( globe.lon_cos );
+  free( globe.lon_sin );
+  band_close( &heights );
+  band_close( &mask );
+  binfile_close( &input_bin );
+  binfile_close( &mask_bin );
+  progress_stage( &progress, "close", 0 );
+  if( fclose( output_file ) != 0 )
+  {
+    printf( "ERROR: failed to write output file: %s\n", output_file_name );
+    return EXIT_FAILURE;
+  }
+  progress_summary( &progress );
+  if( ( timing_file_name != NULL ) && ( progress_write_json( &progress, timing_file_name ) != 0 ) )
+  {
+    printf( "ERROR: could not write timing file: %s\n", timing_file_name );
+    return EXIT_FAILURE;
+  }
+  progress_free( &progress );
   return EXIT_SUCCESS;
 }
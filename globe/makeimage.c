@@ -17,62 +17,268 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "makeimage.h"
-#include "libattopng.h"
+#include "band.h"
+#include "pngstream.h"
+#include "progress.h"
 
-// Size of 1 arc minute files
-#define SIZE_X 21600
-#define SIZE_Y 10800
 #define OUTPUT_FILE_NAME_SIZE 1024
+// Most longitudes that can be given in a list
+#define MAX_VIEWS 3600
 
-// Used for writing image
-#define RGB(r, g, b ) ((r) | ((g) << 8) | ((b) << 16))
+int max_height;
+int min_height;
 
-// Array to store original file and mask file
-// Note that this may not be portable
-int16_t original[SIZE_X][SIZE_Y];
-int16_t mask[SIZE_X][SIZE_Y];
-int image[SIZE_X][SIZE_Y];
+// One image being made, centred on a longitude.  All of the images
+// are made from the same coloured band of rows
+typedef struct
+{
+  int longitude;
+  int long_offset;
+  char file_name[OUTPUT_FILE_NAME_SIZE];
+  png_stream_t png;
+  unsigned char *image_row;
+  // Coloured rows of the current band, written top row first
+  const uint32_t *colours;
+  int xsize;
+  int first_row;
+  int last_row;
+  int status;
+} view_t;
 
-unsigned char land_gradient[LAND_ROWS][LAND_COLUMNS];
-unsigned char sea_gradient[SEA_ROWS][SEA_COLUMNS];
+// ------------------------------------------------------------------------
+// Parse a list of longitudes, either a comma separated list or a range
+// first:last:step, returns the number found or -1 if it is invalid
 
-int max_height;
-int min_height;
+static int parse_longitudes( const char *text, int *longitudes, int max )
+{
+  int first, last, step;
+  char extra;
+
+  if( sscanf( text, "%d:%d:%d%c", &first, &last, &step, &extra ) == 3 )
+  {
+    if( ( step == 0 ) || ( ( last - first ) / step < 0 ) || ( ( last - first ) / step >= max ) )
+    {
+      return -1;
+    }
+    int count = 0;
+    for( int longitude = first; ( step > 0 ) ? ( longitude <= last ) : ( longitude >= last ); longitude += step )
+    {
+      longitudes[count++] = longitude;
+    }
+    return count;
+  }
+  int count = 0;
+  const char *p = text;
+  for( ;; )
+  {
+    char *end;
+    long longitude = strtol( p, &end, 10 );
+    if( ( end == p ) || ( count == max ) || ( longitude < -360 ) || ( longitude > 360 ) )
+    {
+      return -1;
+    }
+    longitudes[count++] = longitude;
+    if( *end == '\0' )
+    {
+      return count;
+    }
+    if( *end != ',' )
+    {
+      return -1;
+    }
+    p = end + 1;
+  }
+}
+
+// ------------------------------------------------------------------------
+// Write the rows of the current band to one image, rotating each one so
+// that the image is centred on its longitude
+
+static void *view_worker( void *arg )
+{
+  view_t *view = arg;
+  int xsize = view->xsize;
+  int palette = ( view->png.options.palette_size > 0 );
+
+  view->status = 0;
+  for( int y = view->last_row - 1; y >= view->first_row; y-- )
+  {
+    const uint32_t *colours = view->colours + (size_t)( y - view->first_row ) * xsize;
+    unsigned char *image_row = view->image_row;
+    for( int x = 0; x < xsize; x++ )
+    {
+      int xd = x + view->long_offset;
+      if( xd >= xsize )
+      {
+        xd -= xsize;
+      }
+      uint32_t c = colours[xd];
+      if( palette )
+      {
+        image_row[x] = COLOUR_INDEX( c );
+      }
+      else
+      {
+        image_row[3*x] = COLOUR_RED( c );
+        image_row[3*x+1] = COLOUR_GREEN( c );
+        image_row[3*x+2] = COLOUR_BLUE( c );
+      }
+    }
+    if( png_stream_write_row( &view->png, image_row ) != 0 )
+    {
+      view->status = -1;
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: makeimage [options] <input file> <mask file> <terrain LUT> <bathymetry LUT> <xsize> [longitude]\n" );
+  printf( "  ( output will be written to <input file>.png )\n" );
+  printf( "  ( xsize can be 0 if the files have headers, which give the size )\n" );
+  printf( "  Options:\n" );
+  printf( "    -b rows           rows of input held in memory, default %d\n", BAND_ROWS );
+  printf( "    -t threads        number of compression threads, default is one per CPU\n" );
+  printf( "    -z level          compression level, 0 - 9\n" );
+  printf( "    -s strategy       compression strategy: default, filtered, huffman or rle\n" );
+  printf( "    -F filter         row filter: none, sub, up, average, paeth or adaptive\n" );
+  printf( "    -R                always write RGB, not a palette image\n" );
+  printf( "    -l longitudes     make an image centred on each longitude, given as a\n" );
+  printf( "                      list, e.g. 0,90,-90, or a range first:last:step.\n" );
+  printf( "                      Output goes to <input file>_<longitude>.png\n" );
+  printf( "    -j images         most images made at once, default one per thread\n" );
+  printf( "    -i seconds        print progress every this many seconds\n" );
+  printf( "    -J file           write the time taken by each stage to file as JSON\n" );
+}
+
+// ------------------------------------------------------------------------
 
 int main( int argc, char *argv[] )
 {
-  FILE* input_file;
-  FILE *mask_file;
   FILE *terrain_LUT_file;
   FILE *bath_LUT_file;
   int xsize;
   int ysize;
   int longitude;
-  char output_file_name[OUTPUT_FILE_NAME_SIZE];
+  int band_rows = BAND_ROWS;
+  png_options_t png_options;
+  int allow_palette = 1;
+  int longitudes[MAX_VIEWS];
+  int view_count = 0;
+  int in_flight = 0;
+  double progress_interval = 0.0;
+  char *timing_file_name = NULL;
+  int opt;
 
-  printf( "makeimage, v0.1\n" );
+  printf( "makeimage, v0.2\n" );
 
-  // Check command line
-  if( ( argc != 6 ) && ( argc != 7 ) )
+  png_default_options( &png_options );
+  png_options.threads = sysconf( _SC_NPROCESSORS_ONLN );
+  if( png_options.threads < 1 )
   {
-    printf( "ERROR: usage is: makeimage <input file> <mask file> <terrain LUT> <bathymetry LUT> <xsize> [longitude]\n" );
-    printf( "  ( output will be written to <input file>.png )\n" );
-    return EXIT_FAILURE;
+    png_options.threads = 1;
   }
-  // Check input files
-  input_file = fopen( argv[1], "r" );
-  if( input_file == NULL )
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+b:t:z:s:F:Rl:j:i:J:" ) ) != -1 )
   {
-    printf( "ERROR: could not open input file: %s\n", argv[1] );
-    return EXIT_FAILURE;
+    switch( opt )
+    {
+      case 't':
+        png_options.threads = atoi( optarg );
+        if( png_options.threads < 1 )
+        {
+          printf( "ERROR: invalid number of threads: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'z':
+        png_options.level = atoi( optarg );
+        if( ( png_options.level < 0 ) || ( png_options.level > 9 ) )
+        {
+          printf( "ERROR: invalid compression level: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's':
+        if( png_strategy_from_name( optarg, &png_options.strategy ) != 0 )
+        {
+          printf( "ERROR: invalid compression strategy: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'F':
+        if( png_filter_from_name( optarg, &png_options.filter ) != 0 )
+        {
+          printf( "ERROR: invalid filter: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'R':
+        allow_palette = 0;
+        break;
+      case 'l':
+        view_count = parse_longitudes( optarg, longitudes, MAX_VIEWS );
+        if( view_count < 1 )
+        {
+          printf( "ERROR: invalid longitudes: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'j':
+        in_flight = atoi( optarg );
+        if( in_flight < 1 )
+        {
+          printf( "ERROR: invalid number of images: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'b':
+        band_rows = atoi( optarg );
+        if( band_rows < 1 )
+        {
+          printf( "ERROR: invalid band size: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'i':
+        progress_interval = atof( optarg );
+        if( progress_interval <= 0.0 )
+        {
+          printf( "ERROR: invalid progress interval: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'J':
+        timing_file_name = optarg;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
   }
-  mask_file = fopen( argv[2], "r" );
-  if( mask_file == NULL )
+  // Skip over the options so that the positional arguments are
+  // numbered as before
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( ( argc != 6 ) && ( ( argc != 7 ) || ( view_count > 0 ) ) )
   {
-    printf( "ERROR: could not open mask file: %s\n", argv[2] );
+    usage();
     return EXIT_FAILURE;
   }
+  progress_t progress;
+  progress_init( &progress, "makeimage", progress_interval );
   // Read terrain LUT
   terrain_LUT_file = fopen( argv[3], "r" );
   // Read bathymetry LUT
@@ -91,7 +297,7 @@ int main( int argc, char *argv[] )
   }
   // Check xsize factor
   xsize = atoi( argv[5] );
-  if( ( xsize < 1 ) || ( xsize > SIZE_X ) || ( xsize % 2 != 0 ) )
+  if( xsize < 0 )
   {
     printf( "ERROR: invalid X size: %s\n", argv[5] );
     return EXIT_FAILURE;
@@ -112,250 +318,272 @@ int main( int argc, char *argv[] )
   {
     longitude = 0;
   }
-  printf( "Image will be centred on Longitude: %d degrees\n", longitude );
-  // Set ysize
-  ysize = xsize / 2;
-
-  // Create output file name
-  snprintf( output_file_name, OUTPUT_FILE_NAME_SIZE, "%s.png", argv[1] );
-
-  // Read input file into Array
-  int count = 0;
-  int c1, c2;
-  int16_t spot_height;
-  max_height = 0;
-  min_height = 0;
-  printf( "Reading input file...\n" );
-  for( int y = 0; y < ysize; y++ )
+  if( view_count == 0 )
   {
-    for( int x = 0; x < xsize; x++ )
-    {
-      // Read two characters and store
-      c1 = fgetc( input_file );
-      if( c1 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 1\n" );
-        return EXIT_FAILURE;
-      }
-      c2 = fgetc( input_file );
-      if( c2 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 2\n" );
-        return EXIT_FAILURE;
-      }
-      spot_height = ( c1 << 8 ) + c2;
-      if( spot_height > max_height )
-      {
-        max_height = spot_height;
-      }
-      if( spot_height < min_height )
-      {
-        min_height = spot_height;
-      }
-      original[x][y] = spot_height;
-      count++;
-    }
+    printf( "Image will be centred on Longitude: %d degrees\n", longitude );
+    longitudes[0] = longitude;
+    view_count = 1;
   }
-  printf( "%d values read\n", count );
-  printf( "  min: %d, max: %d\n", min_height, max_height );
-  // Read mask file into Array
-  printf( "Reading mask file...\n" );
-  count = 0;
-  for( int y = 0; y < ysize; y++ )
+  else
   {
-    for( int x = 0; x < xsize; x++ )
-    {
-      // Read two characters and store
-      c1 = fgetc( mask_file );
-      if( c1 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 1\n" );
-        return EXIT_FAILURE;
-      }
-      c2 = fgetc( mask_file );
-      if( c2 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 2\n" );
-        return EXIT_FAILURE;
-      }
-      mask[x][y] = ( c1 << 8 ) + c2;
-      count++;
-    }
+    printf( "%d images will be made\n", view_count );
   }
-  printf( "%d values read\n", count );
-  // Read terrain LUT into array
-  unsigned char channel[LAND_ROWS];
-  // Read red channel
-  if( fread( channel, LAND_ROWS, 1, terrain_LUT_file ) != 1 )
+
+  // Map the input and mask files
+  binfile_t input_bin;
+  binfile_t mask_bin;
+  int status = binfile_open( &input_bin, argv[1], xsize, xsize / 2 );
+  if( status != BINFILE_OK )
   {
-    printf( "ERROR: unexpected EOF reached while reading terrain LUT red channel\n" );
+    printf( "ERROR: could not read input file: %s, %s\n", argv[1], binfile_error( status ) );
     return EXIT_FAILURE;
   }
-  for( int x = 0; x < LAND_ROWS; x++ )
+  // A header gives the size of the grid, which needn't be 2:1.  Files
+  // without one are xsize by xsize / 2
+  if( ( xsize != 0 ) && ( input_bin.width != xsize ) )
   {
-    land_gradient[x][0] = channel[x];
+    printf( "ERROR: input file is %d x %d, not %d wide\n", input_bin.width, input_bin.height, xsize );
+    return EXIT_FAILURE;
   }
-  // Read green channel
-  if( fread( channel, LAND_ROWS, 1, terrain_LUT_file ) != 1 )
+  xsize = input_bin.width;
+  ysize = input_bin.height;
+  status = binfile_open( &mask_bin, argv[2], xsize, ysize );
+  if( status != BINFILE_OK )
   {
-    printf( "ERROR: unexpected EOF reached while reading terrain LUT green channel\n" );
+    printf( "ERROR: could not read mask file: %s, %s\n", argv[2], binfile_error( status ) );
     return EXIT_FAILURE;
   }
-  for( int x = 0; x < LAND_ROWS; x++ )
+  if( ( mask_bin.width != xsize ) || ( mask_bin.height != ysize ) )
   {
-    land_gradient[x][1] = channel[x];
+    printf( "ERROR: mask file is not %d x %d\n", xsize, ysize );
+    return EXIT_FAILURE;
   }
-  // Read blue channel
-  if( fread( channel, LAND_ROWS, 1, terrain_LUT_file ) != 1 )
+  // The files are converted a band of rows at a time so that memory
+  // use doesn't depend on the size of the image
+  band_t heights;
+  band_t mask;
+  if( ( band_open( &heights, &input_bin, band_rows ) != 0 ) ||
+      ( band_open( &mask, &mask_bin, band_rows ) != 0 ) )
   {
-    printf( "ERROR: unexpected EOF reached while reading terrain LUT blue channel\n" );
+    printf( "ERROR: could not allocate input buffers\n" );
     return EXIT_FAILURE;
   }
-  for( int x = 0; x < LAND_ROWS; x++ )
+  // The range for shading comes from the header if there is one,
+  // otherwise the file is scanned
+  printf( "Reading input file...\n" );
+  progress_stage( &progress, "range", ysize );
+  if( !input_bin.has_range )
   {
-    land_gradient[x][2] = channel[x];
+    progress_update( &progress, ysize, (int64_t)xsize * ysize * 2, 0 );
   }
-
-  // Read bathymetry LUT into array
-  unsigned char sea_channel[SEA_ROWS];
-  // Read red channel
-  if( fread( sea_channel, SEA_ROWS, 1, bath_LUT_file ) != 1 )
+  binfile_min_max( &input_bin, &min_height, &max_height );
+  // Shading always starts from sea level
+  if( max_height < 0 )
   {
-    printf( "ERROR: unexpected EOF reached while reading bath LUT red channel\n" );
-    return EXIT_FAILURE;
+    max_height = 0;
   }
-  for( int x = 0; x < SEA_ROWS; x++ )
+  if( min_height > 0 )
   {
-    sea_gradient[x][0] = sea_channel[x];
+    min_height = 0;
   }
-  // Read green channel
-  if( fread( sea_channel, SEA_ROWS, 1, bath_LUT_file ) != 1 )
+  printf( "%lld values read\n", (long long)xsize * ysize );
+  printf( "  min: %d, max: %d\n", min_height, max_height );
+  progress_stage( &progress, "setup", 0 );
+  // Read the LUTs and work out the colour of every height
+  colour_t colour;
+  colour_init( &colour );
+  if( colour_read_lut( terrain_LUT_file, &colour.land_gradient, &colour.land_rows ) != 0 )
   {
-    printf( "ERROR: unexpected EOF reached while reading bath LUT green channel\n" );
+    printf( "ERROR: invalid terrain LUT file: %s\n", argv[3] );
     return EXIT_FAILURE;
   }
-  for( int x = 0; x < SEA_ROWS; x++ )
+  if( colour_read_lut( bath_LUT_file, &colour.sea_gradient, &colour.sea_rows ) != 0 )
   {
-    sea_gradient[x][1] = sea_channel[x];
+    printf( "ERROR: invalid bathymetry LUT file: %s\n", argv[4] );
+    return EXIT_FAILURE;
   }
-  // Read blue channel
-  if( fread( sea_channel, SEA_ROWS, 1, bath_LUT_file ) != 1 )
+  fclose( terrain_LUT_file );
+  fclose( bath_LUT_file );
+  if( colour_build_table( &colour, min_height, max_height ) != 0 )
   {
-    printf( "ERROR: unexpected EOF reached while reading bath LUT blue channel\n" );
+    printf( "ERROR: could not allocate colour table\n" );
     return EXIT_FAILURE;
   }
-  for( int x = 0; x < SEA_ROWS; x++ )
+
+  // If there are few enough different colours then a palette image is
+  // smaller and quicker to compress
+  unsigned char palette[PNG_MAX_PALETTE][3];
+  int palette_size = -1;
+  if( allow_palette )
   {
-    sea_gradient[x][2] = sea_channel[x];
+    palette_size = colour_make_palette( &colour, palette );
   }
-
-  // Write image
-  // Steps for shading
-  float land_step = (float) max_height / (float) LAND_ROWS;
-  float sea_step = -(float) min_height / (float) SEA_ROWS;
-  int long_offset;
-  if( longitude >= 0 )
+  if( palette_size > 0 )
   {
-    long_offset = longitude * ( xsize / 360 );
+    printf( "Writing palette image, %d colours\n", palette_size );
+    png_options.palette = &palette[0][0];
+    png_options.palette_size = palette_size;
   }
   else
   {
-    long_offset = ( 360 + longitude ) * ( xsize / 360 );
+    printf( "Writing RGB image\n" );
   }
-  printf( "Building image file\n" );
-  for( int y = 0; y < ysize; y++ )
+
+  // The images are made in groups, each group sharing one pass through
+  // the input.  The threads are shared between the images of a group,
+  // each image is compressed by its own thread or threads
+  int threads = png_options.threads;
+  if( ( in_flight == 0 ) || ( in_flight > threads ) )
   {
-    for( int x = 0; x < xsize; x++ )
+    in_flight = threads;
+  }
+  if( in_flight > view_count )
+  {
+    in_flight = view_count;
+  }
+  png_options.threads = threads / in_flight;
+  view_t *views = calloc( in_flight, sizeof( view_t ) );
+  uint32_t *colours = malloc( (size_t)xsize * heights.band_rows * sizeof( uint32_t ) );
+  if( ( views == NULL ) || ( colours == NULL ) )
+  {
+    printf( "ERROR: could not allocate image buffers\n" );
+    return EXIT_FAILURE;
+  }
+  int invalid_count = 0;
+  int groups = ( view_count + in_flight - 1 ) / in_flight;
+  progress_stage( &progress, "image", (int64_t)ysize * groups );
+  for( int first_view = 0; first_view < view_count; first_view += in_flight )
+  {
+    int count = view_count - first_view;
+    if( count > in_flight )
+    {
+      count = in_flight;
+    }
+    for( int i = 0; i < count; i++ )
+    {
+      view_t *view = &views[i];
+      view->longitude = longitudes[first_view + i];
+      // Columns to rotate each row by
+      int degrees = ( ( view->longitude % 360 ) + 360 ) % 360;
+      view->long_offset = (int64_t)degrees * xsize / 360;
+      if( view_count == 1 )
+      {
+        snprintf( view->file_name, OUTPUT_FILE_NAME_SIZE, "%s.png", argv[1] );
+      }
+      else
+      {
+        snprintf( view->file_name, OUTPUT_FILE_NAME_SIZE, "%s_%d.png", argv[1], view->longitude );
+      }
+      view->xsize = xsize;
+      view->colours = colours;
+      view->image_row = malloc( (size_t)xsize * 3 );
+      if( ( view->image_row == NULL ) ||
+          ( png_stream_open( &view->png, view->file_name, xsize, ysize, &png_options ) != 0 ) )
+      {
+        printf( "ERROR: could not create image file: %s\n", view->file_name );
+        return EXIT_FAILURE;
+      }
+    }
+    if( view_count == 1 )
+    {
+      printf( "Building image file\n" );
+    }
+    else
+    {
+      printf( "Building images centred on %d to %d degrees\n",
+              views[0].longitude, views[count - 1].longitude );
+    }
+    // The images are built a row at a time, top row first, so the input
+    // is read in bands from the end of the file.  Each band is coloured
+    // once for all of the images
+    for( int top = ysize - 1; top >= 0; top = heights.first_row - 1 )
+    {
+      if( ( band_fetch( &heights, top, 1 ) != 0 ) || ( band_fetch( &mask, top, 1 ) != 0 ) )
+      {
+        printf( "ERROR: unexpected EOF reached while reading input files\n" );
+        return EXIT_FAILURE;
+      }
+      // Heights and mask values
+      progress_update( &progress, 0, (int64_t)( top + 1 - heights.first_row ) * xsize * 4, 0 );
+      for( int y = heights.first_row; y <= top; y++ )
+      {
+        int invalid = colour_row( &colour, band_row( &heights, y ), band_row( &mask, y ),
+                                  xsize, colours + (size_t)( y - heights.first_row ) * xsize );
+        // Only counted on the first pass
+        if( first_view == 0 )
+        {
+          invalid_count += invalid;
+        }
+      }
+      pthread_t ids[count];
+      for( int i = 0; i < count; i++ )
+      {
+        views[i].first_row = heights.first_row;
+        views[i].last_row = top + 1;
+        if( ( count == 1 ) || ( pthread_create( &ids[i], NULL, view_worker, &views[i] ) != 0 ) )
+        {
+          // Do this one here instead
+          ids[i] = pthread_self();
+          view_worker( &views[i] );
+        }
+      }
+      for( int i = 0; i < count; i++ )
+      {
+        if( !pthread_equal( ids[i], pthread_self() ) )
+        {
+          pthread_join( ids[i], NULL );
+        }
+      }
+      for( int i = 0; i < count; i++ )
+      {
+        if( views[i].status != 0 )
+        {
+          printf( "ERROR: failed to write image file: %s\n", views[i].file_name );
+          return EXIT_FAILURE;
+        }
+      }
+      progress_update( &progress, top + 1 - heights.first_row, 0, 0 );
+    }
+    if( view_count == 1 )
+    {
+      printf( "Writing to disk\n" );
+    }
+    for( int i = 0; i < count; i++ )
     {
-      int xd = ( x + long_offset ) % xsize;
-      int r, g, b;
-      int idx;
-      // Process mask
-      // http://ddfe.curtin.edu.au/models/Earth2014/readme_earth2014.dat
-      // 0 - land topography above mean sea level (MSL)
-      // 1 - land topography below MSL
-      // 2 - ocean bathymetry
-      // 3 - inland lake, bedrock above MSL
-      // 4 - inland lake, bedrock below MSL
-      // 5 - ice cover, bedrock above MSL
-      // 6 - ice cover, bedrock below MSL
-      // 7 - ice shelf
-      // 8 - ice covered lake (Vostok)
-      switch( mask[xd][y] )
+      struct stat st;
+      if( ( png_stream_close( &views[i].png ) != 0 ) || ( stat( views[i].file_name, &st ) != 0 ) )
       {
-        case 0:
-        case 1:
-          if( original[xd][y] < 0 )
-          {
-            idx = 0;
-          }
-          else
-          {
-            idx = ( float ) original[xd][y] / land_step;
-            if( idx >= LAND_ROWS )
-            {
-              // May happen at maximum value so set it to maximum row in this case
-              idx = LAND_ROWS - 1;
-            }
-          }
-          r = land_gradient[idx][0];
-          g = land_gradient[idx][1];
-          b = land_gradient[idx][2];
-          break;
-        case 2:
-        case 3:
-        case 4:
-          if( original[xd][y] > 0 )
-          {
-            idx = 0;
-          }
-          else
-          {
-            idx = (float) -original[xd][y] / sea_step;
-            if( idx >= SEA_ROWS )
-            {
-              // May happen at maximum value so set it to maximum row in this case
-              idx = SEA_ROWS - 1;
-            }
-          }
-          r = sea_gradient[SEA_ROWS - 1 - idx][0];
-          g = sea_gradient[SEA_ROWS - 1 - idx][1];
-          b = sea_gradient[SEA_ROWS - 1 - idx][2];
-          break;
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-          r = 255;
-          g = 255;
-          b = 255;
-          break;
-        default:
-          printf( "ERROR: Invalid mask value found, setting to 0,0,0\n" );
-          r = 0;
-          g = 0;
-          b = 0;
-          break;
+        printf( "ERROR: failed to write image file: %s\n", views[i].file_name );
+        return EXIT_FAILURE;
+      }
+      progress_update( &progress, 0, 0, st.st_size );
+      if( view_count > 1 )
+      {
+        printf( "  %s\n", views[i].file_name );
       }
-      //image[x][y] = RGBA( r, g, b, 255);
-      image[x][y] = RGB( r, g, b );
+      free( views[i].image_row );
     }
   }
-  // Write image to file
-  printf( "Writing image file\n" );
-  libattopng_t* png = libattopng_new( xsize, ysize, PNG_RGB );
-  for( int y = 0; y < ysize; y++ )
+  // Report bad mask values once rather than for every point
+  if( invalid_count > 0 )
   {
-    for( int x = 0; x < xsize; x++ )
-    {
-      libattopng_set_pixel(png, x, ysize - y, image[x][y]);
-    }
-    //printf( "%d\n", y );
+    printf( "ERROR: %d invalid mask values found, set to 0,0,0\n", invalid_count );
   }
-  printf( "Writing to disk\n" );
-  libattopng_save( png, output_file_name );
   printf( "Cleaning up\n" );
-  //libattopng_destroy( png );
+  free( views );
+  free( colours );
+  colour_free( &colour );
+  band_close( &heights );
+  band_close( &mask );
+  binfile_close( &input_bin );
+  binfile_close( &mask_bin );
+  progress_summary( &progress );
+  if( ( timing_file_name != NULL ) && ( progress_write_json( &progress, timing_file_name ) != 0 ) )
+  {
+    printf( "ERROR: could not write timing file: %s\n", timing_file_name );
+    return EXIT_FAILURE;
+  }
+  progress_free( &progress );
 
   return EXIT_SUCCESS;
 }
@@ -14,8 +14,5 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-// These values need to be used for LUT creation
-#define LAND_ROWS 256
-#define LAND_COLUMNS 3
-#define SEA_ROWS 256
-#define SEA_COLUMNS 3
+// LUT sizes are in colour.h
+#include "colour.h"
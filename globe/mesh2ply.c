@@ -0,0 +1,251 @@
+// mesh2ply.c - Compact globe mesh to PLY or OBJ converter
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "gmesh.h"
+#include "ply.h"
+
+// Size of the OBJ output buffer
+#define OBJ_BUFFER_SIZE ( 4 * 1024 * 1024 )
+
+// ------------------------------------------------------------------------
+// Verticies of the last block read, as PLY
+
+static int put_ply_vertices( const gmesh_reader_t *reader, ply_buffer_t *buffer )
+{
+  for( int y = reader->first_row; y < reader->first_row + reader->rows; y++ )
+  {
+    for( int x = 0; x < reader->info.xsize; x++ )
+    {
+      float position[3];
+      float normal[3];
+      uint32_t colour;
+      gmesh_vertex( reader, x, y, position, normal, &colour );
+      if( ply_put_vertex( buffer, position[0], position[1], position[2],
+                          COLOUR_RED( colour ), COLOUR_GREEN( colour ), COLOUR_BLUE( colour ),
+                          normal[0], normal[1], normal[2] ) != 0 )
+      {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Verticies of the last block read, as OBJ with the colour after the
+// position and unit normals
+
+static int put_obj_vertices( const gmesh_reader_t *reader, FILE *file )
+{
+  for( int y = reader->first_row; y < reader->first_row + reader->rows; y++ )
+  {
+    for( int x = 0; x < reader->info.xsize; x++ )
+    {
+      float position[3];
+      float normal[3];
+      uint32_t colour;
+      gmesh_vertex( reader, x, y, position, normal, &colour );
+      float length = sqrtf( normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] );
+      if( fprintf( file, "v %.6f %.6f %.6f %.4f %.4f %.4f\nvn %.6f %.6f %.6f\n",
+                   position[0], position[1], position[2],
+                   COLOUR_RED( colour ) / 255.0, COLOUR_GREEN( colour ) / 255.0, COLOUR_BLUE( colour ) / 255.0,
+                   normal[0] / length, normal[1] / length, normal[2] / length ) < 0 )
+      {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Faces between each row and the one above, the same as makeglobe
+
+static int put_faces( int xsize, int ysize, ply_buffer_t *buffer, FILE *obj_file )
+{
+  for( int y = 0; y < ysize - 1; y++ )
+  {
+    // The last quad loops back to the start of the row
+    for( int x = 0; x < xsize; x++ )
+    {
+      int next = ( x + 1 < xsize ) ? x + 1 : 0;
+      int bottom_left = x + ( y * xsize );
+      int bottom_right = next + ( y * xsize );
+      int top_right = next + ( ( y + 1 ) * xsize );
+      int top_left = x + ( ( y + 1 ) * xsize );
+      if( obj_file != NULL )
+      {
+        // OBJ indices start at 1
+        if( fprintf( obj_file, "f %d//%d %d//%d %d//%d %d//%d\n",
+                     bottom_left + 1, bottom_left + 1, bottom_right + 1, bottom_right + 1,
+                     top_right + 1, top_right + 1, top_left + 1, top_left + 1 ) < 0 )
+        {
+          return -1;
+        }
+      }
+      else if( ply_put_face( buffer, bottom_left, bottom_right, top_right, top_left ) != 0 )
+      {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: mesh2ply [options] <input file> <output file>\n" );
+  printf( "  ( input is a compact file from makeglobe -f compact )\n" );
+  printf( "  Options:\n" );
+  printf( "    -f format         ascii or binary PLY, or obj, default ascii\n" );
+}
+
+// ------------------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+  ply_format_t format = PLY_ASCII;
+  int obj = 0;
+  int opt;
+
+  printf( "mesh2ply, v0.1\n" );
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+f:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'f':
+        if( strcmp( optarg, "obj" ) == 0 )
+        {
+          obj = 1;
+        }
+        else if( ply_format_from_name( optarg, &format ) != 0 )
+        {
+          printf( "ERROR: invalid output format: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that argv[1] is the first positional
+  // argument
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( argc != 3 )
+  {
+    usage();
+    return EXIT_FAILURE;
+  }
+  FILE *input_file = fopen( argv[1], "rb" );
+  if( input_file == NULL )
+  {
+    printf( "ERROR: could not open input file: %s\n", argv[1] );
+    return EXIT_FAILURE;
+  }
+  gmesh_reader_t reader;
+  int status = gmesh_open( &reader, input_file );
+  if( status != GMESH_OK )
+  {
+    printf( "ERROR: could not read input file: %s, %s\n", argv[1], gmesh_error( status ) );
+    return EXIT_FAILURE;
+  }
+  int xsize = reader.info.xsize;
+  int ysize = reader.info.ysize;
+  printf( "%d x %d grid, planet radius %d, magnification %d\n",
+          xsize, ysize, reader.info.planet_radius, reader.info.magnification );
+  // Faces index the verticies with ints
+  if( (int64_t)xsize * ysize > INT32_MAX )
+  {
+    printf( "ERROR: %d x %d grid has more than %d verticies\n", xsize, ysize, INT32_MAX );
+    return EXIT_FAILURE;
+  }
+  FILE *output_file = fopen( argv[2], "wb" );
+  if( output_file == NULL )
+  {
+    printf( "ERROR: could not open output file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+
+  // The input is expanded a block at a time so only one block is ever
+  // held in memory
+  ply_buffer_t buffer;
+  if( obj )
+  {
+    setvbuf( output_file, NULL, _IOFBF, OBJ_BUFFER_SIZE );
+    fprintf( output_file, "# created by mesh2ply\n" );
+  }
+  else
+  {
+    if( ply_buffer_init( &buffer, output_file, format, PLY_FACES_INT, PLY_BUFFER_SIZE ) != 0 )
+    {
+      printf( "ERROR: could not allocate output buffer\n" );
+      return EXIT_FAILURE;
+    }
+    ply_write_header( output_file, format, PLY_FACES_INT, (int64_t)xsize * ysize, (int64_t)xsize * ( ysize - 1 ) );
+  }
+  printf( "Writing verticies ...\n" );
+  while( ( status = gmesh_read_block( &reader ) ) > 0 )
+  {
+    if( ( obj && ( put_obj_vertices( &reader, output_file ) != 0 ) ) ||
+        ( !obj && ( put_ply_vertices( &reader, &buffer ) != 0 ) ) )
+    {
+      printf( "ERROR: failed to write output file: %s\n", argv[2] );
+      return EXIT_FAILURE;
+    }
+  }
+  if( status < 0 )
+  {
+    printf( "ERROR: could not read input file: %s, %s\n", argv[1], gmesh_error( status ) );
+    return EXIT_FAILURE;
+  }
+  printf( "Writing faces ...\n" );
+  if( put_faces( xsize, ysize, obj ? NULL : &buffer, obj ? output_file : NULL ) != 0 )
+  {
+    printf( "ERROR: failed to write output file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+  if( !obj )
+  {
+    if( ply_flush( &buffer ) != 0 )
+    {
+      printf( "ERROR: failed to write output file: %s\n", argv[2] );
+      return EXIT_FAILURE;
+    }
+    ply_buffer_free( &buffer );
+  }
+  gmesh_close( &reader );
+  fclose( input_file );
+  if( fclose( output_file ) != 0 )
+  {
+    printf( "ERROR: failed to write output file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
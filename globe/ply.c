@@ -0,0 +1,364 @@
+// ply.c - PLY file writer
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "ply.h"
+
+// Largest record that can be added in one go, an ASCII vertex line
+// is well under this
+#define PLY_MAX_RECORD 256
+
+// ------------------------------------------------------------------------
+// Little endian helpers, these work whatever the host byte order is
+
+static void put_uint32( char *p, uint32_t value )
+{
+  p[0] = value & 0xff;
+  p[1] = ( value >> 8 ) & 0xff;
+  p[2] = ( value >> 16 ) & 0xff;
+  p[3] = ( value >> 24 ) & 0xff;
+}
+
+static void put_float( char *p, float value )
+{
+  uint32_t bits;
+
+  memcpy( &bits, &value, sizeof( bits ) );
+  put_uint32( p, bits );
+}
+
+// ------------------------------------------------------------------------
+// Make sure there is space for another record
+
+static int ply_reserve( ply_buffer_t *buffer, size_t bytes )
+{
+  if( buffer->used + bytes <= buffer->size )
+  {
+    return 0;
+  }
+  if( buffer->file != NULL )
+  {
+    return ply_flush( buffer );
+  }
+  // No file so grow the buffer
+  size_t new_size = buffer->size * 2;
+  while( new_size < buffer->used + bytes )
+  {
+    new_size *= 2;
+  }
+  char *new_data = realloc( buffer->data, new_size );
+  if( new_data == NULL )
+  {
+    return -1;
+  }
+  buffer->data = new_data;
+  buffer->size = new_size;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_format_from_name( const char *name, ply_format_t *format )
+{
+  if( strcmp( name, "ascii" ) == 0 )
+  {
+    *format = PLY_ASCII;
+    return 0;
+  }
+  if( strcmp( name, "binary" ) == 0 )
+  {
+    *format = PLY_BINARY;
+    return 0;
+  }
+  return -1;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_faces_from_name( const char *name, ply_faces_t *faces )
+{
+  if( strcmp( name, "quads" ) == 0 )
+  {
+    *faces = PLY_FACES_INT;
+    return 0;
+  }
+  if( strcmp( name, "triangles" ) == 0 )
+  {
+    *faces = PLY_FACES_UCHAR;
+    return 0;
+  }
+  if( strcmp( name, "strips" ) == 0 )
+  {
+    *faces = PLY_FACES_STRIPS;
+    return 0;
+  }
+  return -1;
+}
+
+// ------------------------------------------------------------------------
+
+void ply_write_header( FILE *file, ply_format_t format, ply_faces_t face_type, int64_t vertices, int64_t faces )
+{
+  fprintf( file, "ply\n" );
+  if( format == PLY_BINARY )
+  {
+    fprintf( file, "format binary_little_endian 1.0\n" );
+  }
+  else
+  {
+    fprintf( file, "format ascii 1.0\n" );
+  }
+  fprintf( file, "comment created by makeglobe\n" );
+  fprintf( file, "element vertex %lld\n", (long long)vertices );
+  fprintf( file, "property float x\n" );
+  fprintf( file, "property float y\n" );
+  fprintf( file, "property float z\n" );
+  fprintf( file, "property uchar red\n" );
+  fprintf( file, "property uchar green\n" );
+  fprintf( file, "property uchar blue\n" );
+  fprintf( file, "property float nx\n" );
+  fprintf( file, "property float ny\n" );
+  fprintf( file, "property float nz\n" );
+  switch( face_type )
+  {
+    case PLY_FACES_INT:
+      fprintf( file, "element face %lld\n", (long long)faces );
+      fprintf( file, "property list int int vertex_index\n" );
+      break;
+    case PLY_FACES_UCHAR:
+      fprintf( file, "element face %lld\n", (long long)faces );
+      fprintf( file, "property list uchar int vertex_index\n" );
+      break;
+    case PLY_FACES_STRIPS:
+      fprintf( file, "element tristrips 1\n" );
+      fprintf( file, "property list int int vertex_indices\n" );
+      break;
+  }
+  fprintf( file, "end_header\n" );
+}
+
+// ------------------------------------------------------------------------
+// The strips are a single list, the number of indices in it comes
+// first and the list is ended once all of the indices are written
+
+int ply_write_strip_start( FILE *file, ply_format_t format, int64_t indices )
+{
+  if( format == PLY_BINARY )
+  {
+    char count[4];
+    put_uint32( count, indices );
+    return ( fwrite( count, sizeof( count ), 1, file ) == 1 ) ? 0 : -1;
+  }
+  return ( fprintf( file, "%lld", (long long)indices ) < 0 ) ? -1 : 0;
+}
+
+int ply_write_strip_end( FILE *file, ply_format_t format )
+{
+  if( format == PLY_BINARY )
+  {
+    return 0;
+  }
+  return ( fprintf( file, "\n" ) < 0 ) ? -1 : 0;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_buffer_init( ply_buffer_t *buffer, FILE *file, ply_format_t format, ply_faces_t faces, size_t size )
+{
+  if( size < PLY_MAX_RECORD )
+  {
+    size = PLY_MAX_RECORD;
+  }
+  buffer->file = file;
+  buffer->format = format;
+  buffer->faces = faces;
+  buffer->used = 0;
+  buffer->size = size;
+  buffer->data = malloc( size );
+  if( buffer->data == NULL )
+  {
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_put_vertex( ply_buffer_t *buffer, float x, float y, float z,
+                    int r, int g, int b, float nx, float ny, float nz )
+{
+  if( ply_reserve( buffer, PLY_MAX_RECORD ) != 0 )
+  {
+    return -1;
+  }
+  char *p = buffer->data + buffer->used;
+  if( buffer->format == PLY_BINARY )
+  {
+    // 3 floats, 3 uchars, 3 floats, no padding
+    put_float( p, x );
+    put_float( p + 4, y );
+    put_float( p + 8, z );
+    p[12] = r;
+    p[13] = g;
+    p[14] = b;
+    put_float( p + 15, nx );
+    put_float( p + 19, ny );
+    put_float( p + 23, nz );
+    buffer->used += 27;
+  }
+  else
+  {
+    buffer->used += snprintf( p, PLY_MAX_RECORD, "%.6f %.6f %.6f %d %d %d %.6f %.6f %.6f\n",
+                              x, y, z, r, g, b, nx, ny, nz );
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_put_face( ply_buffer_t *buffer, int v1, int v2, int v3, int v4 )
+{
+  if( ply_reserve( buffer, PLY_MAX_RECORD ) != 0 )
+  {
+    return -1;
+  }
+  char *p = buffer->data + buffer->used;
+  if( buffer->format == PLY_BINARY )
+  {
+    // Count followed by the indices, all as int
+    put_uint32( p, 4 );
+    put_uint32( p + 4, v1 );
+    put_uint32( p + 8, v2 );
+    put_uint32( p + 12, v3 );
+    put_uint32( p + 16, v4 );
+    buffer->used += 20;
+  }
+  else
+  {
+    buffer->used += snprintf( p, PLY_MAX_RECORD, "4 %d %d %d %d\n", v1, v2, v3, v4 );
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_put_triangle( ply_buffer_t *buffer, int v1, int v2, int v3 )
+{
+  if( ply_reserve( buffer, PLY_MAX_RECORD ) != 0 )
+  {
+    return -1;
+  }
+  char *p = buffer->data + buffer->used;
+  if( ( buffer->format == PLY_BINARY ) && ( buffer->faces == PLY_FACES_UCHAR ) )
+  {
+    p[0] = 3;
+    put_uint32( p + 1, v1 );
+    put_uint32( p + 5, v2 );
+    put_uint32( p + 9, v3 );
+    buffer->used += 13;
+  }
+  else if( buffer->format == PLY_BINARY )
+  {
+    put_uint32( p, 3 );
+    put_uint32( p + 4, v1 );
+    put_uint32( p + 8, v2 );
+    put_uint32( p + 12, v3 );
+    buffer->used += 16;
+  }
+  else
+  {
+    buffer->used += snprintf( p, PLY_MAX_RECORD, "3 %d %d %d\n", v1, v2, v3 );
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Add an index to the strip list, -1 starts a new strip
+
+int ply_put_strip_index( ply_buffer_t *buffer, int v )
+{
+  if( ply_reserve( buffer, PLY_MAX_RECORD ) != 0 )
+  {
+    return -1;
+  }
+  char *p = buffer->data + buffer->used;
+  if( buffer->format == PLY_BINARY )
+  {
+    put_uint32( p, v );
+    buffer->used += 4;
+  }
+  else
+  {
+    buffer->used += snprintf( p, PLY_MAX_RECORD, " %d", v );
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Add data that has already been formatted, such as a compressed block
+
+int ply_put_bytes( ply_buffer_t *buffer, const void *data, size_t bytes )
+{
+  if( ply_reserve( buffer, bytes ) != 0 )
+  {
+    return -1;
+  }
+  if( buffer->used + bytes > buffer->size )
+  {
+    // Too big for the buffer even when empty
+    return ( fwrite( data, bytes, 1, buffer->file ) == 1 ) ? 0 : -1;
+  }
+  memcpy( buffer->data + buffer->used, data, bytes );
+  buffer->used += bytes;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int ply_flush( ply_buffer_t *buffer )
+{
+  return ply_write_to( buffer, buffer->file );
+}
+
+// ------------------------------------------------------------------------
+// Write the contents of the buffer to a file and empty it, used for
+// buffers that aren't attached to a file
+
+int ply_write_to( ply_buffer_t *buffer, FILE *file )
+{
+  if( ( file != NULL ) && ( buffer->used > 0 ) )
+  {
+    if( fwrite( buffer->data, buffer->used, 1, file ) != 1 )
+    {
+      return -1;
+    }
+  }
+  buffer->used = 0;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+void ply_buffer_free( ply_buffer_t *buffer )
+{
+  free( buffer->data );
+  buffer->data = NULL;
+  buffer->used = 0;
+  buffer->size = 0;
+}
@@ -0,0 +1,72 @@
+// ply.h - PLY file writer
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PLY_H
+#define PLY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Default size of the output buffer
+#define PLY_BUFFER_SIZE ( 4 * 1024 * 1024 )
+
+// Output file formats
+typedef enum
+{
+  PLY_ASCII,
+  PLY_BINARY
+} ply_format_t;
+
+// How faces are written
+typedef enum
+{
+  PLY_FACES_INT,     // list of faces with int vertex counts
+  PLY_FACES_UCHAR,   // list of faces with uchar vertex counts
+  PLY_FACES_STRIPS   // one triangle strip list, -1 restarts a strip
+} ply_faces_t;
+
+// Output buffer
+// If file is set then the buffer is written out when full, otherwise
+// it grows so that it can be written out later
+typedef struct
+{
+  FILE *file;
+  ply_format_t format;
+  ply_faces_t faces;
+  char *data;
+  size_t used;
+  size_t size;
+} ply_buffer_t;
+
+int ply_format_from_name( const char *name, ply_format_t *format );
+int ply_faces_from_name( const char *name, ply_faces_t *faces );
+void ply_write_header( FILE *file, ply_format_t format, ply_faces_t face_type, int64_t vertices, int64_t faces );
+int ply_write_strip_start( FILE *file, ply_format_t format, int64_t indices );
+int ply_write_strip_end( FILE *file, ply_format_t format );
+
+int ply_buffer_init( ply_buffer_t *buffer, FILE *file, ply_format_t format, ply_faces_t faces, size_t size );
+int ply_put_vertex( ply_buffer_t *buffer, float x, float y, float z,
+                    int r, int g, int b, float nx, float ny, float nz );
+int ply_put_face( ply_buffer_t *buffer, int v1, int v2, int v3, int v4 );
+int ply_put_triangle( ply_buffer_t *buffer, int v1, int v2, int v3 );
+int ply_put_strip_index( ply_buffer_t *buffer, int v );
+int ply_put_bytes( ply_buffer_t *buffer, const void *data, size_t bytes );
+int ply_flush( ply_buffer_t *buffer );
+int ply_write_to( ply_buffer_t *buffer, FILE *file );
+void ply_buffer_free( ply_buffer_t *buffer );
+
+#endif
@@ -0,0 +1,496 @@
+// pngstream.c - Writes PNG files a row at a time
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "pngstream.h"
+
+// ------------------------------------------------------------------------
+// PNG values are big endian
+
+static void put_uint32( unsigned char *p, uint32_t value )
+{
+  p[0] = ( value >> 24 ) & 0xff;
+  p[1] = ( value >> 16 ) & 0xff;
+  p[2] = ( value >> 8 ) & 0xff;
+  p[3] = value & 0xff;
+}
+
+// ------------------------------------------------------------------------
+// Write a complete chunk: length, type, data and CRC of type + data
+
+static int write_chunk( FILE *file, const char *type, const unsigned char *data, uint32_t length )
+{
+  unsigned char buf[4];
+  uint32_t crc;
+
+  put_uint32( buf, length );
+  if( fwrite( buf, 4, 1, file ) != 1 )
+  {
+    return -1;
+  }
+  if( fwrite( type, 4, 1, file ) != 1 )
+  {
+    return -1;
+  }
+  if( ( length > 0 ) && ( fwrite( data, length, 1, file ) != 1 ) )
+  {
+    return -1;
+  }
+  crc = crc32( 0, (const unsigned char *)type, 4 );
+  if( length > 0 )
+  {
+    crc = crc32( crc, data, length );
+  }
+  put_uint32( buf, crc );
+  if( fwrite( buf, 4, 1, file ) != 1 )
+  {
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+void png_default_options( png_options_t *options )
+{
+  options->level = Z_DEFAULT_COMPRESSION;
+  options->strategy = Z_DEFAULT_STRATEGY;
+  options->filter = PNG_FILTER_DEFAULT;
+  options->threads = 1;
+  options->palette_size = 0;
+  options->palette = NULL;
+}
+
+int png_filter_from_name( const char *name, int *filter )
+{
+  static const char *names[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+
+  for( int i = 0; i < 6; i++ )
+  {
+    if( strcmp( name, names[i] ) == 0 )
+    {
+      *filter = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int png_strategy_from_name( const char *name, int *strategy )
+{
+  if( strcmp( name, "default" ) == 0 )
+  {
+    *strategy = Z_DEFAULT_STRATEGY;
+  }
+  else if( strcmp( name, "filtered" ) == 0 )
+  {
+    *strategy = Z_FILTERED;
+  }
+  else if( strcmp( name, "huffman" ) == 0 )
+  {
+    *strategy = Z_HUFFMAN_ONLY;
+  }
+  else if( strcmp( name, "rle" ) == 0 )
+  {
+    *strategy = Z_RLE;
+  }
+  else
+  {
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Apply one filter type to a row, out gets the filter byte followed by
+// the filtered row.  Returns the sum of the filtered bytes taken as
+// signed values, which is used to choose between filters
+
+static long filter_row( int filter, const unsigned char *row, const unsigned char *previous,
+                        size_t row_bytes, int bpp, unsigned char *out )
+{
+  long sum = 0;
+
+  out[0] = filter;
+  out++;
+  for( size_t i = 0; i < row_bytes; i++ )
+  {
+    int left = ( i >= (size_t)bpp ) ? row[i - bpp] : 0;
+    int up = previous[i];
+    int up_left = ( i >= (size_t)bpp ) ? previous[i - bpp] : 0;
+    int predict;
+    switch( filter )
+    {
+      case PNG_FILTER_SUB:
+        predict = left;
+        break;
+      case PNG_FILTER_UP:
+        predict = up;
+        break;
+      case PNG_FILTER_AVERAGE:
+        predict = ( left + up ) >> 1;
+        break;
+      case PNG_FILTER_PAETH:
+      {
+        int p = left + up - up_left;
+        int pa = abs( p - left );
+        int pb = abs( p - up );
+        int pc = abs( p - up_left );
+        if( ( pa <= pb ) && ( pa <= pc ) )
+        {
+          predict = left;
+        }
+        else if( pb <= pc )
+        {
+          predict = up;
+        }
+        else
+        {
+          predict = up_left;
+        }
+        break;
+      }
+      default:
+        predict = 0;
+        break;
+    }
+    out[i] = row[i] - predict;
+    sum += abs( (signed char)out[i] );
+  }
+  return sum;
+}
+
+// ------------------------------------------------------------------------
+// Compress one block as raw deflate data using the data before it as a
+// dictionary.  All but the last block end with a sync flush so that the
+// blocks can simply be joined together
+
+static void *compress_block( void *arg )
+{
+  png_block_t *block = arg;
+  z_stream stream;
+
+  block->status = -1;
+  block->out_used = 0;
+  block->adler = adler32( adler32( 0, NULL, 0 ), block->in, block->in_size );
+  memset( &stream, 0, sizeof( stream ) );
+  if( deflateInit2( &stream, block->level, Z_DEFLATED, -15, 8, block->strategy ) != Z_OK )
+  {
+    return NULL;
+  }
+  if( ( block->dictionary_size > 0 ) &&
+      ( deflateSetDictionary( &stream, block->dictionary, block->dictionary_size ) != Z_OK ) )
+  {
+    deflateEnd( &stream );
+    return NULL;
+  }
+  size_t needed = deflateBound( &stream, block->in_size ) + 64;
+  if( block->out_size < needed )
+  {
+    unsigned char *out = realloc( block->out, needed );
+    if( out == NULL )
+    {
+      deflateEnd( &stream );
+      return NULL;
+    }
+    block->out = out;
+    block->out_size = needed;
+  }
+  stream.next_in = (unsigned char *)block->in;
+  stream.avail_in = block->in_size;
+  stream.next_out = block->out;
+  stream.avail_out = block->out_size;
+  int status = deflate( &stream, block->last ? Z_FINISH : Z_SYNC_FLUSH );
+  if( ( status == Z_STREAM_END ) || ( ( status == Z_OK ) && ( stream.avail_in == 0 ) && ( stream.avail_out > 0 ) ) )
+  {
+    block->out_used = block->out_size - stream.avail_out;
+    block->status = 0;
+  }
+  deflateEnd( &stream );
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Compress the waiting data, one block per thread, and write it out in
+// order.  If last is set this is the end of the image data
+
+static int compress_input( png_stream_t *png, int last )
+{
+  int threads = png->options.threads;
+  pthread_t ids[threads];
+  size_t offset = 0;
+
+  do
+  {
+    // Split into blocks
+    int count = 0;
+    do
+    {
+      png_block_t *block = &png->blocks[count];
+      block->in = png->input + offset;
+      block->in_size = png->input_used - offset;
+      if( block->in_size > PNG_BLOCK_SIZE )
+      {
+        block->in_size = PNG_BLOCK_SIZE;
+      }
+      if( offset == 0 )
+      {
+        block->dictionary = png->window;
+        block->dictionary_size = png->window_used;
+      }
+      else
+      {
+        // Earlier blocks are at least a window in size
+        block->dictionary = block->in - PNG_WINDOW_SIZE;
+        block->dictionary_size = PNG_WINDOW_SIZE;
+      }
+      block->level = png->options.level;
+      block->strategy = png->options.strategy;
+      offset += block->in_size;
+      block->last = last && ( offset == png->input_used );
+      count++;
+    } while( ( offset < png->input_used ) && ( count < threads ) );
+
+    // Compress them
+    if( count == 1 )
+    {
+      compress_block( &png->blocks[0] );
+    }
+    else
+    {
+      for( int i = 0; i < count; i++ )
+      {
+        if( pthread_create( &ids[i], NULL, compress_block, &png->blocks[i] ) != 0 )
+        {
+          // Do this one here instead
+          ids[i] = pthread_self();
+          compress_block( &png->blocks[i] );
+        }
+      }
+      for( int i = 0; i < count; i++ )
+      {
+        if( !pthread_equal( ids[i], pthread_self() ) )
+        {
+          pthread_join( ids[i], NULL );
+        }
+      }
+    }
+
+    // Write them out
+    for( int i = 0; i < count; i++ )
+    {
+      png_block_t *block = &png->blocks[i];
+      if( block->status != 0 )
+      {
+        return -1;
+      }
+      if( ( block->out_used > 0 ) && ( write_chunk( png->file, "IDAT", block->out, block->out_used ) != 0 ) )
+      {
+        return -1;
+      }
+      png->adler = adler32_combine( png->adler, block->adler, block->in_size );
+    }
+  } while( offset < png->input_used );
+
+  // Keep the end of the data as the dictionary for the next block
+  if( offset >= PNG_WINDOW_SIZE )
+  {
+    memcpy( png->window, png->input + offset - PNG_WINDOW_SIZE, PNG_WINDOW_SIZE );
+    png->window_used = PNG_WINDOW_SIZE;
+  }
+  else
+  {
+    size_t keep = PNG_WINDOW_SIZE - offset;
+    if( keep > png->window_used )
+    {
+      keep = png->window_used;
+    }
+    memmove( png->window, png->window + png->window_used - keep, keep );
+    memcpy( png->window + keep, png->input, offset );
+    png->window_used = keep + offset;
+  }
+  png->input_used = 0;
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+int png_stream_open( png_stream_t *png, const char *file_name, int width, int height,
+                     const png_options_t *options )
+{
+  static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+  static const unsigned char zlib_header[2] = { 0x78, 0x9c };
+  unsigned char ihdr[13];
+
+  memset( png, 0, sizeof( *png ) );
+  png->width = width;
+  png->height = height;
+  png->options = *options;
+  if( png->options.threads < 1 )
+  {
+    png->options.threads = 1;
+  }
+  if( ( png->options.palette_size < 0 ) || ( png->options.palette_size > PNG_MAX_PALETTE ) )
+  {
+    return -1;
+  }
+  png->bytes_per_pixel = ( png->options.palette_size > 0 ) ? 1 : 3;
+  if( png->options.filter == PNG_FILTER_DEFAULT )
+  {
+    png->options.filter = ( png->options.palette_size > 0 ) ? PNG_FILTER_NONE : PNG_FILTER_ADAPTIVE;
+  }
+  png->row_bytes = (size_t)width * png->bytes_per_pixel;
+  png->adler = adler32( 0, NULL, 0 );
+
+  // Room for a block per thread plus a row
+  png->input_size = png->options.threads * PNG_BLOCK_SIZE + png->row_bytes + 1;
+  png->input = malloc( png->input_size );
+  png->previous = calloc( png->row_bytes, 1 );
+  png->trial = malloc( 5 * ( png->row_bytes + 1 ) );
+  png->blocks = calloc( png->options.threads, sizeof( png_block_t ) );
+  if( ( png->input == NULL ) || ( png->previous == NULL ) ||
+      ( png->trial == NULL ) || ( png->blocks == NULL ) )
+  {
+    return -1;
+  }
+
+  png->file = fopen( file_name, "wb" );
+  if( png->file == NULL )
+  {
+    return -1;
+  }
+  if( fwrite( signature, sizeof( signature ), 1, png->file ) != 1 )
+  {
+    return -1;
+  }
+  // 8 bit RGB or palette, no interlace
+  put_uint32( ihdr, width );
+  put_uint32( ihdr + 4, height );
+  ihdr[8] = 8;
+  ihdr[9] = ( png->options.palette_size > 0 ) ? 3 : 2;
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+  if( write_chunk( png->file, "IHDR", ihdr, sizeof( ihdr ) ) != 0 )
+  {
+    return -1;
+  }
+  if( ( png->options.palette_size > 0 ) &&
+      ( write_chunk( png->file, "PLTE", png->options.palette, 3 * png->options.palette_size ) != 0 ) )
+  {
+    return -1;
+  }
+  // The zlib header goes in its own chunk, the compressed blocks follow
+  return write_chunk( png->file, "IDAT", zlib_header, sizeof( zlib_header ) );
+}
+
+// ------------------------------------------------------------------------
+// Add the next row, width * 3 bytes of RGB data or width palette indices
+
+int png_stream_write_row( png_stream_t *png, const unsigned char *row )
+{
+  if( png->rows >= png->height )
+  {
+    return -1;
+  }
+  unsigned char *out = png->input + png->input_used;
+  if( png->options.filter == PNG_FILTER_ADAPTIVE )
+  {
+    // Try them all and keep the one with the smallest sum
+    int best = PNG_FILTER_NONE;
+    long best_sum = -1;
+    for( int filter = PNG_FILTER_NONE; filter <= PNG_FILTER_PAETH; filter++ )
+    {
+      long sum = filter_row( filter, row, png->previous, png->row_bytes, png->bytes_per_pixel,
+                             png->trial + filter * ( png->row_bytes + 1 ) );
+      if( ( best_sum < 0 ) || ( sum < best_sum ) )
+      {
+        best = filter;
+        best_sum = sum;
+      }
+    }
+    memcpy( out, png->trial + best * ( png->row_bytes + 1 ), png->row_bytes + 1 );
+  }
+  else
+  {
+    filter_row( png->options.filter, row, png->previous, png->row_bytes, png->bytes_per_pixel, out );
+  }
+  memcpy( png->previous, row, png->row_bytes );
+  png->input_used += png->row_bytes + 1;
+  png->rows++;
+
+  // Compress once there is a block for each thread, the last of the
+  // data is left for png_stream_close
+  if( ( png->input_used >= png->options.threads * PNG_BLOCK_SIZE ) && ( png->rows < png->height ) )
+  {
+    return compress_input( png, 0 );
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Finish the compressed data and close the file, any rows not written
+// are an error
+
+int png_stream_close( png_stream_t *png )
+{
+  int status = 0;
+
+  if( png->file != NULL )
+  {
+    if( ( png->rows != png->height ) || ( compress_input( png, 1 ) != 0 ) )
+    {
+      status = -1;
+    }
+    else
+    {
+      // The checksum of the uncompressed data ends the zlib stream
+      unsigned char adler[4];
+      put_uint32( adler, png->adler );
+      if( ( write_chunk( png->file, "IDAT", adler, 4 ) != 0 ) ||
+          ( write_chunk( png->file, "IEND", NULL, 0 ) != 0 ) )
+      {
+        status = -1;
+      }
+    }
+    if( fclose( png->file ) != 0 )
+    {
+      status = -1;
+    }
+    png->file = NULL;
+  }
+  if( png->blocks != NULL )
+  {
+    for( int i = 0; i < png->options.threads; i++ )
+    {
+      free( png->blocks[i].out );
+    }
+  }
+  free( png->blocks );
+  free( png->input );
+  free( png->previous );
+  free( png->trial );
+  png->blocks = NULL;
+  png->input = NULL;
+  png->previous = NULL;
+  png->trial = NULL;
+  return status;
+}
@@ -0,0 +1,101 @@
+// pngstream.h - Writes PNG files a row at a time
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PNGSTREAM_H
+#define PNGSTREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Amount of filtered image data compressed as one block, each thread
+// works on one block at a time
+#define PNG_BLOCK_SIZE ( 256 * 1024 )
+// Deflate window, each block uses the data before it as a dictionary
+#define PNG_WINDOW_SIZE 32768
+// PNG limit on the number of palette entries
+#define PNG_MAX_PALETTE 256
+
+// Row filters, PNG_FILTER_ADAPTIVE picks the best for each row
+#define PNG_FILTER_NONE 0
+#define PNG_FILTER_SUB 1
+#define PNG_FILTER_UP 2
+#define PNG_FILTER_AVERAGE 3
+#define PNG_FILTER_PAETH 4
+#define PNG_FILTER_ADAPTIVE 5
+// Adaptive for RGB, none for palette images
+#define PNG_FILTER_DEFAULT -1
+
+typedef struct
+{
+  int level;                    // zlib compression level
+  int strategy;                 // zlib strategy
+  int filter;                   // one of the PNG_FILTER_ values
+  int threads;                  // threads used for compression
+  int palette_size;             // 0 for RGB, otherwise indexed
+  const unsigned char *palette; // palette_size RGB entries
+} png_options_t;
+
+// One block of data being compressed
+typedef struct
+{
+  const unsigned char *in;
+  size_t in_size;
+  const unsigned char *dictionary;
+  size_t dictionary_size;
+  int last;
+  int level;
+  int strategy;
+  unsigned char *out;
+  size_t out_size;
+  size_t out_used;
+  uint32_t adler;
+  int status;
+} png_block_t;
+
+// Rows are written top to bottom and filtered as they arrive.  The
+// filtered data is compressed in blocks, possibly several at once, so
+// the whole image is never held in memory
+typedef struct
+{
+  FILE *file;
+  int width;
+  int height;
+  int rows;                 // rows written so far
+  int bytes_per_pixel;
+  size_t row_bytes;
+  png_options_t options;
+  unsigned char *previous;  // previous row before filtering
+  unsigned char *trial;     // filtered rows for each filter type
+  unsigned char *input;     // filtered data waiting to be compressed
+  size_t input_used;
+  size_t input_size;
+  unsigned char window[PNG_WINDOW_SIZE];  // end of the data already compressed
+  size_t window_used;
+  uint32_t adler;           // of all the data compressed so far
+  png_block_t *blocks;
+} png_stream_t;
+
+void png_default_options( png_options_t *options );
+int png_filter_from_name( const char *name, int *filter );
+int png_strategy_from_name( const char *name, int *strategy );
+
+int png_stream_open( png_stream_t *png, const char *file_name, int width, int height,
+                     const png_options_t *options );
+int png_stream_write_row( png_stream_t *png, const unsigned char *row );
+int png_stream_close( png_stream_t *png );
+
+#endif
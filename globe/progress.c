@@ -0,0 +1,202 @@
+// progress.c - Stage timing and progress reports for the globe tools
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "progress.h"
+
+#define MEGABYTE ( 1024.0 * 1024.0 )
+
+// ------------------------------------------------------------------------
+
+static double now( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ------------------------------------------------------------------------
+
+void progress_init( progress_t *progress, const char *tool, double interval )
+{
+  memset( progress, 0, sizeof( progress_t ) );
+  progress->tool = tool;
+  progress->interval = interval;
+  progress->start = now();
+  progress->last_line = progress->start;
+  pthread_mutex_init( &progress->lock, NULL );
+}
+
+// ------------------------------------------------------------------------
+// Finish the current stage, if there is one, and start the next.  Stages
+// past the last one allowed are added to it
+
+void progress_stage( progress_t *progress, const char *name, int64_t total_rows )
+{
+  pthread_mutex_lock( &progress->lock );
+  double t = now();
+  if( progress->running )
+  {
+    progress_stage_t *stage = &progress->stages[progress->stage_count - 1];
+    stage->seconds = t - stage->start;
+  }
+  if( progress->stage_count < PROGRESS_MAX_STAGES )
+  {
+    progress_stage_t *stage = &progress->stages[progress->stage_count++];
+    memset( stage, 0, sizeof( progress_stage_t ) );
+    stage->name = name;
+    stage->total_rows = total_rows;
+  }
+  progress->stages[progress->stage_count - 1].start = t;
+  progress->running = 1;
+  progress->last_line = t;
+  pthread_mutex_unlock( &progress->lock );
+}
+
+// ------------------------------------------------------------------------
+// Add to the counts for the current stage and print a progress line if
+// it is time for one
+
+void progress_update( progress_t *progress, int64_t rows, int64_t bytes_in, int64_t bytes_out )
+{
+  pthread_mutex_lock( &progress->lock );
+  if( !progress->running )
+  {
+    pthread_mutex_unlock( &progress->lock );
+    return;
+  }
+  progress_stage_t *stage = &progress->stages[progress->stage_count - 1];
+  stage->rows += rows;
+  stage->bytes_in += bytes_in;
+  stage->bytes_out += bytes_out;
+  if( progress->interval > 0.0 )
+  {
+    double t = now();
+    if( t - progress->last_line >= progress->interval )
+    {
+      double elapsed = t - stage->start;
+      double rate = ( elapsed > 0.0 ) ? stage->rows / elapsed : 0.0;
+      progress->last_line = t;
+      printf( "  %s: %lld", stage->name, (long long)stage->rows );
+      if( stage->total_rows > 0 )
+      {
+        printf( " / %lld rows, %.1f%%", (long long)stage->total_rows, 100.0 * stage->rows / stage->total_rows );
+      }
+      else
+      {
+        printf( " rows" );
+      }
+      printf( ", %.0f rows/s", rate );
+      if( ( stage->total_rows > 0 ) && ( rate > 0.0 ) )
+      {
+        int left = ( stage->total_rows - stage->rows ) / rate + 0.5;
+        printf( ", ETA %d:%02d:%02d", left / 3600, ( left / 60 ) % 60, left % 60 );
+      }
+      printf( "\n" );
+      // Progress lines are no use if they sit in a buffer
+      fflush( stdout );
+    }
+  }
+  pthread_mutex_unlock( &progress->lock );
+}
+
+// ------------------------------------------------------------------------
+
+void progress_end( progress_t *progress )
+{
+  pthread_mutex_lock( &progress->lock );
+  if( progress->running )
+  {
+    progress_stage_t *stage = &progress->stages[progress->stage_count - 1];
+    stage->seconds = now() - stage->start;
+    progress->running = 0;
+  }
+  pthread_mutex_unlock( &progress->lock );
+}
+
+// ------------------------------------------------------------------------
+// Print the time taken by each stage, ending the last one
+
+void progress_summary( progress_t *progress )
+{
+  progress_end( progress );
+  double total = now() - progress->start;
+
+  printf( "Timings:\n" );
+  for( int i = 0; i < progress->stage_count; i++ )
+  {
+    const progress_stage_t *stage = &progress->stages[i];
+    printf( "  %-12s %9.3f s", stage->name, stage->seconds );
+    if( stage->rows > 0 )
+    {
+      printf( ", %lld rows, %.0f rows/s", (long long)stage->rows,
+              ( stage->seconds > 0.0 ) ? stage->rows / stage->seconds : 0.0 );
+    }
+    if( stage->bytes_in > 0 )
+    {
+      printf( ", %.1f MB in", stage->bytes_in / MEGABYTE );
+    }
+    if( stage->bytes_out > 0 )
+    {
+      printf( ", %.1f MB out", stage->bytes_out / MEGABYTE );
+    }
+    printf( "\n" );
+  }
+  printf( "  %-12s %9.3f s\n", "total", total );
+}
+
+// ------------------------------------------------------------------------
+// Write the same as the summary as JSON, returns -1 if the file can't be
+// written
+
+int progress_write_json( progress_t *progress, const char *file_name )
+{
+  progress_end( progress );
+  double total = now() - progress->start;
+  FILE *file = fopen( file_name, "w" );
+
+  if( file == NULL )
+  {
+    return -1;
+  }
+  fprintf( file, "{\n" );
+  fprintf( file, "  \"tool\": \"%s\",\n", progress->tool );
+  fprintf( file, "  \"seconds\": %.6f,\n", total );
+  fprintf( file, "  \"stages\": [\n" );
+  for( int i = 0; i < progress->stage_count; i++ )
+  {
+    const progress_stage_t *stage = &progress->stages[i];
+    fprintf( file, "    { \"name\": \"%s\", \"seconds\": %.6f, \"rows\": %lld, \"total_rows\": %lld, "
+             "\"rows_per_second\": %.1f, \"bytes_in\": %lld, \"bytes_out\": %lld }%s\n",
+             stage->name, stage->seconds, (long long)stage->rows, (long long)stage->total_rows,
+             ( stage->seconds > 0.0 ) ? stage->rows / stage->seconds : 0.0,
+             (long long)stage->bytes_in, (long long)stage->bytes_out,
+             ( i + 1 < progress->stage_count ) ? "," : "" );
+  }
+  fprintf( file, "  ]\n" );
+  fprintf( file, "}\n" );
+  return ( fclose( file ) == 0 ) ? 0 : -1;
+}
+
+// ------------------------------------------------------------------------
+
+void progress_free( progress_t *progress )
+{
+  pthread_mutex_destroy( &progress->lock );
+}
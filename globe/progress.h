@@ -0,0 +1,61 @@
+// progress.h - Stage timing and progress reports for the globe tools
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+// A run is split into named stages, one after the other.  Each stage
+// counts the rows it has done, out of a total if one is known, and the
+// bytes read and written.  Times come from the monotonic clock.  With
+// an interval set a progress line is printed every interval seconds
+// with the rate and, if the total is known, the time left
+#define PROGRESS_MAX_STAGES 16
+
+typedef struct
+{
+  const char *name;
+  double start;
+  double seconds;       // set when the stage ends
+  int64_t rows;
+  int64_t total_rows;   // 0 if not known
+  int64_t bytes_in;
+  int64_t bytes_out;
+} progress_stage_t;
+
+typedef struct
+{
+  const char *tool;
+  double interval;      // seconds between progress lines, 0 for none
+  double start;
+  double last_line;
+  int stage_count;
+  int running;          // the last stage hasn't ended
+  progress_stage_t stages[PROGRESS_MAX_STAGES];
+  pthread_mutex_t lock; // progress_update can be called from any thread
+} progress_t;
+
+void progress_init( progress_t *progress, const char *tool, double interval );
+void progress_stage( progress_t *progress, const char *name, int64_t total_rows );
+void progress_update( progress_t *progress, int64_t rows, int64_t bytes_in, int64_t bytes_out );
+void progress_end( progress_t *progress );
+void progress_summary( progress_t *progress );
+int progress_write_json( progress_t *progress, const char *file_name );
+void progress_free( progress_t *progress );
+
+#endif
@@ -0,0 +1,699 @@
+// renderglobe.c - Rotating globe frame renderer
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "colour.h"
+#include "binfile.h"
+#include "pngstream.h"
+
+#define OUTPUT_FILE_NAME_SIZE 1024
+// Default frame size and number of frames in a turn
+#define FRAME_WIDTH 1920
+#define FRAME_HEIGHT 1080
+#define FRAMES 36
+// Radius of the Earth in metres, for the slopes used by hillshading
+#define EARTH_RADIUS 6371000.0
+// Longitudes are held as fixed point column numbers
+#define COLUMN_BITS 16
+
+int max_height;
+int min_height;
+
+// Everything that doesn't change from frame to frame.  Turning the
+// globe about its axis only shifts every point along its row of the
+// input, so the inverse projection of each pixel is only worked out
+// once.  The pixels that hit the globe in each image row are a single
+// run, their values are stored one run after the other
+typedef struct
+{
+  const binfile_t *heights;
+  const binfile_t *mask;
+  const colour_t *colour;
+  int xsize;
+  int ysize;
+  int width;
+  int height;
+  int *run_first;       // first pixel of the run in each image row
+  int *run_count;       // pixels in the run
+  size_t *run_offset;   // index of the run's first pixel values
+  uint64_t *column;     // fixed point input column at the starting longitude
+  uint32_t *row;        // input row
+  // Hillshading, the light in the east, north and up directions of
+  // each point, zero if not shading
+  int shade;
+  float *light_east;
+  float *light_north;
+  float *light_up;
+  float *slope_east;    // height difference to slope for each input row
+  float slope_north;
+  float ambient;
+  // Frames
+  int frames;
+  double longitude;     // centre of the first frame
+  const char *prefix;
+  png_options_t png_options;
+  // Next frame to render, shared by the threads
+  pthread_mutex_t lock;
+  int next_frame;
+  int status;
+} view_t;
+
+// ------------------------------------------------------------------------
+// Work out where every pixel that hits the globe comes from.  The view
+// is centred on latitude and the starting longitude, north is up.  An
+// orthographic view is used if distance is 0, otherwise the eye is
+// that many globe radii from the centre.  radius is the size of the
+// globe's outline in pixels
+
+static int view_init( view_t *view, double latitude, double distance, double radius,
+                      const double *light, double exaggeration )
+{
+  int width = view->width;
+  int height = view->height;
+  double sin_lat = sin( latitude * M_PI / 180.0 );
+  double cos_lat = cos( latitude * M_PI / 180.0 );
+  // Focal length that makes the outline the right size
+  double focal = 0.0;
+  if( distance > 0.0 )
+  {
+    focal = radius / tan( asin( 1.0 / distance ) );
+  }
+
+  view->run_first = malloc( height * sizeof( int ) );
+  view->run_count = malloc( height * sizeof( int ) );
+  view->run_offset = malloc( height * sizeof( size_t ) );
+  view->slope_east = malloc( view->ysize * sizeof( float ) );
+  if( ( view->run_first == NULL ) || ( view->run_count == NULL ) ||
+      ( view->run_offset == NULL ) || ( view->slope_east == NULL ) )
+  {
+    return -1;
+  }
+  // Sizes of the runs first, so the values can be allocated in one go
+  double *points = malloc( (size_t)width * 3 * sizeof( double ) );
+  if( points == NULL )
+  {
+    return -1;
+  }
+  size_t total = 0;
+  for( int pass = 0; pass < 2; pass++ )
+  {
+    if( pass == 1 )
+    {
+      view->column = malloc( total * sizeof( uint64_t ) );
+      view->row = malloc( total * sizeof( uint32_t ) );
+      if( ( view->column == NULL ) || ( view->row == NULL ) )
+      {
+        free( points );
+        return -1;
+      }
+      if( view->shade )
+      {
+        view->light_east = malloc( total * sizeof( float ) );
+        view->light_north = malloc( total * sizeof( float ) );
+        view->light_up = malloc( total * sizeof( float ) );
+        if( ( view->light_east == NULL ) || ( view->light_north == NULL ) || ( view->light_up == NULL ) )
+        {
+          free( points );
+          return -1;
+        }
+      }
+    }
+    total = 0;
+    for( int y = 0; y < height; y++ )
+    {
+      // Point on the globe seen through each pixel, x right, y up and z
+      // towards the eye
+      double py = height / 2.0 - ( y + 0.5 );
+      int first = -1;
+      int count = 0;
+      for( int x = 0; x < width; x++ )
+      {
+        double px = x + 0.5 - width / 2.0;
+        double p[3];
+        if( distance > 0.0 )
+        {
+          double length = sqrt( px * px + py * py + focal * focal );
+          double d[3] = { px / length, py / length, -focal / length };
+          double b = distance * d[2];
+          double disc = b * b - ( distance * distance - 1.0 );
+          if( disc < 0.0 )
+          {
+            continue;
+          }
+          double t = -b - sqrt( disc );
+          p[0] = t * d[0];
+          p[1] = t * d[1];
+          p[2] = distance + t * d[2];
+        }
+        else
+        {
+          double u = px / radius;
+          double v = py / radius;
+          double r2 = u * u + v * v;
+          if( r2 > 1.0 )
+          {
+            continue;
+          }
+          p[0] = u;
+          p[1] = v;
+          p[2] = sqrt( 1.0 - r2 );
+        }
+        if( first < 0 )
+        {
+          first = x;
+        }
+        memcpy( points + 3 * count, p, sizeof( p ) );
+        count++;
+      }
+      view->run_first[y] = ( first < 0 ) ? 0 : first;
+      view->run_count[y] = count;
+      view->run_offset[y] = total;
+      if( pass == 1 )
+      {
+        for( int i = 0; i < count; i++ )
+        {
+          const double *p = points + 3 * i;
+          size_t k = total + i;
+          // Into globe coordinates, z through the north pole and x
+          // through the starting longitude
+          double w[3] = { -p[1] * sin_lat + p[2] * cos_lat,
+                          p[0],
+                          p[1] * cos_lat + p[2] * sin_lat };
+          double point_lat = asin( w[2] < -1.0 ? -1.0 : ( w[2] > 1.0 ? 1.0 : w[2] ) );
+          double point_lon = atan2( w[1], w[0] );
+          // Input row and fixed point column
+          int row = floor( ( point_lat * 180.0 / M_PI + 90.0 ) * view->ysize / 180.0 );
+          view->row[k] = ( row < 0 ) ? 0 : ( ( row >= view->ysize ) ? view->ysize - 1 : row );
+          double column = ( point_lon * 180.0 / M_PI + 180.0 ) * view->xsize / 360.0;
+          uint64_t fixed = (uint64_t)( column * ( 1 << COLUMN_BITS ) );
+          if( fixed >= ( (uint64_t)view->xsize << COLUMN_BITS ) )
+          {
+            fixed -= (uint64_t)view->xsize << COLUMN_BITS;
+          }
+          view->column[k] = fixed;
+          if( view->shade )
+          {
+            // The light in globe coordinates, split into the point's
+            // east, north and up directions.  These stay the same as
+            // the globe turns
+            double l[3] = { -light[1] * sin_lat + light[2] * cos_lat,
+                            light[0],
+                            light[1] * cos_lat + light[2] * sin_lat };
+            double east[3] = { -sin( point_lon ), cos( point_lon ), 0.0 };
+            double north[3] = { -sin( point_lat ) * cos( point_lon ),
+                                -sin( point_lat ) * sin( point_lon ),
+                                cos( point_lat ) };
+            view->light_east[k] = l[0] * east[0] + l[1] * east[1];
+            view->light_north[k] = l[0] * north[0] + l[1] * north[1] + l[2] * north[2];
+            view->light_up[k] = l[0] * w[0] + l[1] * w[1] + l[2] * w[2];
+          }
+        }
+      }
+      total += count;
+    }
+  }
+  free( points );
+
+  // Central differences across two cells give the slope
+  for( int y = 0; y < view->ysize; y++ )
+  {
+    double row_lat = ( -90.0 + ( y + 0.5 ) * 180.0 / view->ysize ) * M_PI / 180.0;
+    double cell = 2.0 * M_PI * EARTH_RADIUS * cos( row_lat ) / view->xsize;
+    view->slope_east[y] = exaggeration / ( 2.0 * cell );
+  }
+  view->slope_north = exaggeration / ( 2.0 * M_PI * EARTH_RADIUS / view->ysize );
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+static void view_free( view_t *view )
+{
+  free( view->run_first );
+  free( view->run_count );
+  free( view->run_offset );
+  free( view->column );
+  free( view->row );
+  free( view->light_east );
+  free( view->light_north );
+  free( view->light_up );
+  free( view->slope_east );
+}
+
+// ------------------------------------------------------------------------
+// Brightness of a point from the slope of the terrain around it, 0 -
+// 256
+
+static int hillshade( const view_t *view, size_t k, int x, int y )
+{
+  const binfile_t *heights = view->heights;
+  int xsize = view->xsize;
+  int west = ( x > 0 ) ? x - 1 : xsize - 1;
+  int east = ( x < xsize - 1 ) ? x + 1 : 0;
+  int south = ( y > 0 ) ? y - 1 : y;
+  int north = ( y < view->ysize - 1 ) ? y + 1 : y;
+  float gx = ( binfile_get( heights, east, y ) - binfile_get( heights, west, y ) ) * view->slope_east[y];
+  float gy = ( binfile_get( heights, x, north ) - binfile_get( heights, x, south ) ) * view->slope_north;
+  float lit = ( view->light_up[k] - gx * view->light_east[k] - gy * view->light_north[k] ) /
+              sqrtf( gx * gx + gy * gy + 1.0f );
+  if( lit < 0.0f )
+  {
+    lit = 0.0f;
+  }
+  return 256.0f * ( view->ambient + ( 1.0f - view->ambient ) * lit );
+}
+
+// ------------------------------------------------------------------------
+// Render one frame straight into its PNG file a row at a time
+
+static int render_frame( view_t *view, int frame, unsigned char *image_row )
+{
+  char file_name[OUTPUT_FILE_NAME_SIZE];
+  png_stream_t png;
+  uint64_t wrap = (uint64_t)view->xsize << COLUMN_BITS;
+
+  // Turn the globe the way the Earth turns, so the centre longitude
+  // goes down from frame to frame
+  double longitude = view->longitude - 360.0 * frame / view->frames;
+  double shift = fmod( longitude * view->xsize / 360.0, view->xsize );
+  if( shift < 0.0 )
+  {
+    shift += view->xsize;
+  }
+  uint64_t offset = (uint64_t)( shift * ( 1 << COLUMN_BITS ) ) % wrap;
+
+  snprintf( file_name, OUTPUT_FILE_NAME_SIZE, "%s_%04d.png", view->prefix, frame );
+  if( png_stream_open( &png, file_name, view->width, view->height, &view->png_options ) != 0 )
+  {
+    printf( "ERROR: could not create image file: %s\n", file_name );
+    return -1;
+  }
+  for( int y = 0; y < view->height; y++ )
+  {
+    memset( image_row, 0, (size_t)view->width * 3 );
+    unsigned char *out = image_row + 3 * view->run_first[y];
+    size_t first = view->run_offset[y];
+    for( size_t k = first; k < first + view->run_count[y]; k++ )
+    {
+      uint64_t column = view->column[k] + offset;
+      if( column >= wrap )
+      {
+        column -= wrap;
+      }
+      int x = column >> COLUMN_BITS;
+      int row = view->row[k];
+      uint32_t c = colour_get( view->colour, binfile_get( view->heights, x, row ),
+                               binfile_get( view->mask, x, row ) );
+      if( view->shade )
+      {
+        int brightness = hillshade( view, k, x, row );
+        out[0] = ( COLOUR_RED( c ) * brightness ) >> 8;
+        out[1] = ( COLOUR_GREEN( c ) * brightness ) >> 8;
+        out[2] = ( COLOUR_BLUE( c ) * brightness ) >> 8;
+      }
+      else
+      {
+        out[0] = COLOUR_RED( c );
+        out[1] = COLOUR_GREEN( c );
+        out[2] = COLOUR_BLUE( c );
+      }
+      out += 3;
+    }
+    if( png_stream_write_row( &png, image_row ) != 0 )
+    {
+      printf( "ERROR: failed to write image file: %s\n", file_name );
+      return -1;
+    }
+  }
+  if( png_stream_close( &png ) != 0 )
+  {
+    printf( "ERROR: failed to write image file: %s\n", file_name );
+    return -1;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Render frames until there are none left, each thread has one frame
+// in progress at a time
+
+static void *frame_worker( void *arg )
+{
+  view_t *view = arg;
+  unsigned char *image_row = malloc( (size_t)view->width * 3 );
+
+  if( image_row == NULL )
+  {
+    printf( "ERROR: could not allocate image buffer\n" );
+    pthread_mutex_lock( &view->lock );
+    view->status = -1;
+    pthread_mutex_unlock( &view->lock );
+    return NULL;
+  }
+  for( ;; )
+  {
+    // Stop taking frames once one has failed
+    pthread_mutex_lock( &view->lock );
+    int frame = ( view->status == 0 ) ? view->next_frame++ : view->frames;
+    pthread_mutex_unlock( &view->lock );
+    if( frame >= view->frames )
+    {
+      break;
+    }
+    if( render_frame( view, frame, image_row ) != 0 )
+    {
+      pthread_mutex_lock( &view->lock );
+      view->status = -1;
+      pthread_mutex_unlock( &view->lock );
+      break;
+    }
+  }
+  free( image_row );
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: renderglobe [options] <input file> <mask file> <terrain LUT> <bathymetry LUT> <xsize> <output prefix>\n" );
+  printf( "  ( frames will be written to <output prefix>_0000.png onwards )\n" );
+  printf( "  ( xsize can be 0 if the files have headers, which give the size )\n" );
+  printf( "  Options:\n" );
+  printf( "    -s WxH            frame size, default %dx%d\n", FRAME_WIDTH, FRAME_HEIGHT );
+  printf( "    -r radius         radius of the globe in pixels, default 0.45 x height\n" );
+  printf( "    -n frames         frames in one turn of the globe, default %d\n", FRAMES );
+  printf( "    -l longitude      centre of the first frame, default 0\n" );
+  printf( "    -a latitude       latitude at the centre of the view, default 0\n" );
+  printf( "    -d distance       perspective view from this many globe radii from the\n" );
+  printf( "                      centre, default is an orthographic view\n" );
+  printf( "    -H exaggeration   hillshade, lit from the top left, heights exaggerated\n" );
+  printf( "                      by this much.  0 just shades the sphere\n" );
+  printf( "    -A ambient        light in shadow for hillshading, 0 - 1, default 0.25\n" );
+  printf( "    -t threads        number of threads, default is one per CPU\n" );
+  printf( "    -z level          compression level, 0 - 9\n" );
+}
+
+// ------------------------------------------------------------------------
+
+int main( int argc, char *argv[] )
+{
+  FILE *terrain_LUT_file;
+  FILE *bath_LUT_file;
+  int xsize;
+  int ysize;
+  int width = FRAME_WIDTH;
+  int height = FRAME_HEIGHT;
+  double radius = 0.0;
+  int frames = FRAMES;
+  double longitude = 0.0;
+  double latitude = 0.0;
+  double distance = 0.0;
+  int shade = 0;
+  double exaggeration = 0.0;
+  double ambient = 0.25;
+  int threads = sysconf( _SC_NPROCESSORS_ONLN );
+  png_options_t png_options;
+  int opt;
+
+  printf( "renderglobe, v0.1\n" );
+  if( threads < 1 )
+  {
+    threads = 1;
+  }
+  png_default_options( &png_options );
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+s:r:n:l:a:d:H:A:t:z:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 's':
+        if( ( sscanf( optarg, "%dx%d", &width, &height ) != 2 ) || ( width < 1 ) || ( height < 1 ) )
+        {
+          printf( "ERROR: invalid frame size: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'r':
+        radius = atof( optarg );
+        if( radius <= 0.0 )
+        {
+          printf( "ERROR: invalid radius: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'n':
+        frames = atoi( optarg );
+        if( frames < 1 )
+        {
+          printf( "ERROR: invalid number of frames: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'l':
+        longitude = atof( optarg );
+        break;
+      case 'a':
+        latitude = atof( optarg );
+        if( ( latitude < -90.0 ) || ( latitude > 90.0 ) )
+        {
+          printf( "ERROR: invalid latitude: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'd':
+        distance = atof( optarg );
+        if( distance <= 1.0 )
+        {
+          printf( "ERROR: invalid distance, must be more than 1: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'H':
+        shade = 1;
+        exaggeration = atof( optarg );
+        if( exaggeration < 0.0 )
+        {
+          printf( "ERROR: invalid exaggeration: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'A':
+        ambient = atof( optarg );
+        if( ( ambient < 0.0 ) || ( ambient > 1.0 ) )
+        {
+          printf( "ERROR: invalid ambient light: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 't':
+        threads = atoi( optarg );
+        if( threads < 1 )
+        {
+          printf( "ERROR: invalid number of threads: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'z':
+        png_options.level = atoi( optarg );
+        if( ( png_options.level < 0 ) || ( png_options.level > 9 ) )
+        {
+          printf( "ERROR: invalid compression level: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that argv[1] is the first positional
+  // argument
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( argc != 7 )
+  {
+    usage();
+    return EXIT_FAILURE;
+  }
+  terrain_LUT_file = fopen( argv[3], "r" );
+  if( terrain_LUT_file == NULL )
+  {
+    printf( "ERROR: could not open terrain LUT file: %s\n", argv[3] );
+    return EXIT_FAILURE;
+  }
+  bath_LUT_file = fopen( argv[4], "r" );
+  if( bath_LUT_file == NULL )
+  {
+    printf( "ERROR: could not open bathymetry LUT file: %s\n", argv[4] );
+    return EXIT_FAILURE;
+  }
+  xsize = atoi( argv[5] );
+  if( xsize < 0 )
+  {
+    printf( "ERROR: invalid X size: %s\n", argv[5] );
+    return EXIT_FAILURE;
+  }
+  if( radius == 0.0 )
+  {
+    radius = 0.45 * height;
+  }
+
+  // Map the input and mask files, frames sample them all over so the
+  // whole of both is read in at the start
+  binfile_t input_bin;
+  binfile_t mask_bin;
+  int status = binfile_open( &input_bin, argv[1], xsize, xsize / 2 );
+  if( status != BINFILE_OK )
+  {
+    printf( "ERROR: could not read input file: %s, %s\n", argv[1], binfile_error( status ) );
+    return EXIT_FAILURE;
+  }
+  // A header gives the size of the grid, which needn't be 2:1.  Files
+  // without one are xsize by xsize / 2
+  if( ( xsize != 0 ) && ( input_bin.width != xsize ) )
+  {
+    printf( "ERROR: input file is %d x %d, not %d wide\n", input_bin.width, input_bin.height, xsize );
+    return EXIT_FAILURE;
+  }
+  xsize = input_bin.width;
+  ysize = input_bin.height;
+  status = binfile_open( &mask_bin, argv[2], xsize, ysize );
+  if( status != BINFILE_OK )
+  {
+    printf( "ERROR: could not read mask file: %s, %s\n", argv[2], binfile_error( status ) );
+    return EXIT_FAILURE;
+  }
+  if( ( mask_bin.width != xsize ) || ( mask_bin.height != ysize ) )
+  {
+    printf( "ERROR: mask file is not %d x %d\n", xsize, ysize );
+    return EXIT_FAILURE;
+  }
+  binfile_will_need( &input_bin, 0, ysize );
+  binfile_will_need( &mask_bin, 0, ysize );
+  printf( "Reading input file...\n" );
+  binfile_min_max( &input_bin, &min_height, &max_height );
+  // Shading always starts from sea level
+  if( max_height < 0 )
+  {
+    max_height = 0;
+  }
+  if( min_height > 0 )
+  {
+    min_height = 0;
+  }
+  printf( "%lld values read\n", (long long)xsize * ysize );
+  printf( "  min: %d, max: %d\n", min_height, max_height );
+
+  // Read the LUTs and work out the colour of every height
+  colour_t colour;
+  colour_init( &colour );
+  if( colour_read_lut( terrain_LUT_file, &colour.land_gradient, &colour.land_rows ) != 0 )
+  {
+    printf( "ERROR: invalid terrain LUT file: %s\n", argv[3] );
+    return EXIT_FAILURE;
+  }
+  if( colour_read_lut( bath_LUT_file, &colour.sea_gradient, &colour.sea_rows ) != 0 )
+  {
+    printf( "ERROR: invalid bathymetry LUT file: %s\n", argv[4] );
+    return EXIT_FAILURE;
+  }
+  fclose( terrain_LUT_file );
+  fclose( bath_LUT_file );
+  if( colour_build_table( &colour, min_height, max_height ) != 0 )
+  {
+    printf( "ERROR: could not allocate colour table\n" );
+    return EXIT_FAILURE;
+  }
+
+  // Work out the projection once for all of the frames
+  view_t view;
+  memset( &view, 0, sizeof( view ) );
+  view.heights = &input_bin;
+  view.mask = &mask_bin;
+  view.colour = &colour;
+  view.xsize = xsize;
+  view.ysize = ysize;
+  view.width = width;
+  view.height = height;
+  view.shade = shade;
+  view.ambient = ambient;
+  view.frames = frames;
+  view.longitude = longitude;
+  view.prefix = argv[6];
+  // Light from the top left and in front
+  double light[3] = { -1.0 / sqrt( 3.0 ), 1.0 / sqrt( 3.0 ), 1.0 / sqrt( 3.0 ) };
+  printf( "Setting up %s view, %d x %d\n", ( distance > 0.0 ) ? "perspective" : "orthographic", width, height );
+  if( view_init( &view, latitude, distance, radius, light, exaggeration ) != 0 )
+  {
+    printf( "ERROR: could not allocate view tables\n" );
+    return EXIT_FAILURE;
+  }
+
+  // Each thread renders whole frames, with their own compression, so
+  // there are never more frames in progress than threads
+  if( threads > frames )
+  {
+    threads = frames;
+  }
+  png_options.threads = 1;
+  pthread_mutex_init( &view.lock, NULL );
+  view.next_frame = 0;
+  view.status = 0;
+  printf( "Rendering %d frames\n", frames );
+  printf( "  Using %d thread(s)\n", threads );
+  pthread_t ids[threads];
+  for( int i = 0; i < threads; i++ )
+  {
+    if( pthread_create( &ids[i], NULL, frame_worker, &view ) != 0 )
+    {
+      // Do the rest here instead
+      ids[i] = pthread_self();
+      frame_worker( &view );
+    }
+  }
+  for( int i = 0; i < threads; i++ )
+  {
+    if( !pthread_equal( ids[i], pthread_self() ) )
+    {
+      pthread_join( ids[i], NULL );
+    }
+  }
+  pthread_mutex_destroy( &view.lock );
+  if( view.status != 0 )
+  {
+    return EXIT_FAILURE;
+  }
+
+  printf( "Cleaning up\n" );
+  view_free( &view );
+  colour_free( &colour );
+  binfile_close( &input_bin );
+  binfile_close( &mask_bin );
+
+  return EXIT_SUCCESS;
+}
@@ -17,35 +17,186 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "binfile.h"
+#include "band.h"
+#include "scale.h"
+#include "progress.h"
 
-// Size of 1 arc minute files
+// Size of 1 arc minute files, used if the input file has no header
 #define SIZE_X 21600
 #define SIZE_Y 10800
+#define OUTPUT_FILE_NAME_SIZE 1024
+#define MAX_LEVELS 16
 
-// Array to store original file
-// Note that this may not be portable
-int16_t original[SIZE_X][SIZE_Y];
+// One output file, the first is scaled from the input and each of the
+// others is half the size of the one before
+typedef struct
+{
+  scaler_t scaler;
+  char file_name[OUTPUT_FILE_NAME_SIZE];
+  FILE *file;
+  int min;
+  int max;
+  int count;
+} level_t;
+
+// ------------------------------------------------------------------------
+// Pass a row to a level, write out any rows that it can now make and
+// pass them on to the next level
+
+static int feed_level( level_t *levels, int level_count, int level, int y, const int16_t *row )
+{
+  level_t *l = &levels[level];
+  const int16_t *out;
+  int out_y;
+
+  if( !scaler_wants_row( &l->scaler, y ) )
+  {
+    return 0;
+  }
+  scaler_push_row( &l->scaler, y, row );
+  while( ( out = scaler_next_row( &l->scaler, &out_y ) ) != NULL )
+  {
+    int n = l->scaler.out_width;
+    for( int x = 0; x < n; x++ )
+    {
+      if( out[x] < l->min )
+      {
+        l->min = out[x];
+      }
+      if( out[x] > l->max )
+      {
+        l->max = out[x];
+      }
+    }
+    if( binfile_write_values( l->file, out, n ) != 0 )
+    {
+      return -1;
+    }
+    l->count += n;
+    if( ( level + 1 < level_count ) && ( feed_level( levels, level_count, level + 1, out_y, out ) != 0 ) )
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: rescale [options] <input file> <scale> <output file>\n" );
+  printf( "  ( Scale is an integer, e.g. 2 = reduce by half )\n" );
+  printf( "  Options:\n" );
+  printf( "    -f filter         nearest, box or lanczos, default nearest\n" );
+  printf( "    -p levels         write a pyramid of levels, each half the size of\n" );
+  printf( "                      the one before, to <output file>_<scale>.bin\n" );
+  printf( "    -x width          input width if the file has no header, default %d\n", SIZE_X );
+  printf( "    -y height         input height if the file has no header, default %d\n", SIZE_Y );
+  printf( "    -R                raw output, without the header giving the size and\n" );
+  printf( "                      range of the data\n" );
+  printf( "    -i seconds        print progress every this many seconds\n" );
+  printf( "    -J file           write the time taken by each stage to file as JSON\n" );
+}
+
+// ------------------------------------------------------------------------
 
 int main( int argc, char *argv[] )
 {
-  FILE* input_file;
+  binfile_t input_bin;
   int scale;
-  FILE* output_file;
+  scale_type_t type = SCALE_NEAREST;
+  int level_count = 1;
+  int width = SIZE_X;
+  int height = SIZE_Y;
+  int header = 1;
+  double progress_interval = 0.0;
+  char *timing_file_name = NULL;
+  int opt;
 
-  printf( "rescaler, v0.1\n" );
+  printf( "rescaler, v0.2\n" );
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+f:p:x:y:HRi:J:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'f':
+        if( scale_type_from_name( optarg, &type ) != 0 )
+        {
+          printf( "ERROR: invalid filter: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'p':
+        level_count = atoi( optarg );
+        if( ( level_count < 1 ) || ( level_count > MAX_LEVELS ) )
+        {
+          printf( "ERROR: invalid number of levels: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'x':
+        width = atoi( optarg );
+        if( width < 1 )
+        {
+          printf( "ERROR: invalid width: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'y':
+        height = atoi( optarg );
+        if( height < 1 )
+        {
+          printf( "ERROR: invalid height: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'H':
+        // Headers are written by default now, kept for old scripts
+        header = 1;
+        break;
+      case 'R':
+        header = 0;
+        break;
+      case 'i':
+        progress_interval = atof( optarg );
+        if( progress_interval <= 0.0 )
+        {
+          printf( "ERROR: invalid progress interval: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'J':
+        timing_file_name = optarg;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that the positional arguments are
+  // numbered as before
+  argc -= optind - 1;
+  argv += optind - 1;
 
   // Check command line
   if( argc != 4 )
   {
-    printf( "ERROR: usage is: rescale <input file> <scale> <output file >\n" );
-    printf( "  ( Scale is an integer, e.g. 2 = reduce by half )\n" );
+    usage();
     return EXIT_FAILURE;
   }
+  progress_t progress;
+  progress_init( &progress, "rescale", progress_interval );
+  progress_stage( &progress, "setup", 0 );
   // Check input file
-  input_file = fopen( argv[1], "r" );
-  if( input_file == NULL )
+  int status = binfile_open( &input_bin, argv[1], width, height );
+  if( status != BINFILE_OK )
   {
-    printf( "ERROR: could not open input file: %s\n", argv[1] );
+    printf( "ERROR: could not read input file: %s, %s\n", argv[1], binfile_error( status ) );
     return EXIT_FAILURE;
   }
   // Check scale factor
@@ -55,59 +206,127 @@ int main( int argc, char *argv[] )
     printf( "ERROR: invalid scale factor: %s\n", argv[2] );
     return EXIT_FAILURE;
   }
-  // Check output file
-  output_file = fopen( argv[3], "w" );
-  if( output_file == NULL )
+  printf( "%lld values read\n", (long long)input_bin.width * input_bin.height );
+
+  // Set up the output levels, a single level goes to the file named
+  // on the command line as before
+  level_t levels[MAX_LEVELS];
+  int level_width = input_bin.width;
+  int level_height = input_bin.height;
+  int factor = scale;
+  char base_name[OUTPUT_FILE_NAME_SIZE];
+  snprintf( base_name, OUTPUT_FILE_NAME_SIZE, "%s", argv[3] );
+  size_t length = strlen( base_name );
+  if( ( length > 4 ) && ( strcmp( base_name + length - 4, ".bin" ) == 0 ) )
   {
-    printf( "ERROR: could not open output file: %s\n", argv[3] );
-    return EXIT_FAILURE;
+    base_name[length - 4] = '\0';
   }
-  // Read input file into Array
-  int count = 0;
-  int c1, c2;
-  for( int y = 0; y < SIZE_Y; y++ )
+  for( int i = 0; i < level_count; i++ )
   {
-    for( int x = 0; x < SIZE_X; x++ )
+    level_t *l = &levels[i];
+    if( scaler_init( &l->scaler, type, level_width, level_height, ( i == 0 ) ? scale : 2 ) != 0 )
     {
-      // Read two characters and store
-      c1 = fgetc( input_file );
-      if( c1 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 1\n" );
-        return EXIT_FAILURE;
-      }
-      c2 = fgetc( input_file );
-      if( c2 == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while reading 2\n" );
-        return EXIT_FAILURE;
-      }
-      original[x][y] = ( c1 << 8 ) + c2;
-      count++;
+      printf( "ERROR: could not allocate scaling buffers\n" );
+      return EXIT_FAILURE;
+    }
+    if( level_count == 1 )
+    {
+      snprintf( l->file_name, OUTPUT_FILE_NAME_SIZE, "%s", argv[3] );
+    }
+    else
+    {
+      snprintf( l->file_name, OUTPUT_FILE_NAME_SIZE, "%s_%d.bin", base_name, factor );
+    }
+    l->file = fopen( l->file_name, "w" );
+    if( l->file == NULL )
+    {
+      printf( "ERROR: could not open output file: %s\n", l->file_name );
+      return EXIT_FAILURE;
+    }
+    // The range isn't known yet so the header is written again at the end
+    if( header && ( binfile_write_header( l->file, l->scaler.out_width, l->scaler.out_height, 0, 0 ) != 0 ) )
+    {
+      printf( "ERROR: unexpected EOF reached while writing header\n" );
+      return EXIT_FAILURE;
     }
+    l->min = INT16_MAX;
+    l->max = INT16_MIN;
+    l->count = 0;
+    level_width = l->scaler.out_width;
+    level_height = l->scaler.out_height;
+    factor *= 2;
   }
-  printf( "%d values read\n", count );
 
-  // Write out
-  count = 0;
-  for( int y = 0; y < SIZE_Y; y+=scale )
+  // Every level is made from a single read of the input, a row at a
+  // time and only the rows used are read
+  band_t input;
+  if( band_open( &input, &input_bin, 1 ) != 0 )
   {
-    for( int x = 0; x < SIZE_X; x+=scale )
+    printf( "ERROR: could not allocate row buffer\n" );
+    return EXIT_FAILURE;
+  }
+  progress_stage( &progress, "scale", input_bin.height );
+  int64_t written = 0;
+  for( int y = 0; y < input_bin.height; y++ )
+  {
+    if( !scaler_wants_row( &levels[0].scaler, y ) )
     {
-      if( fputc( original[x][y] >> 8, output_file ) == EOF )
-      {
-        printf( "ERROR: unexpected EOF reached while writing 1\n" );
-        return EXIT_FAILURE;
-      }
-      if( fputc( original[x][y], output_file ) == EOF )
+      progress_update( &progress, 1, 0, 0 );
+      continue;
+    }
+    if( band_read( &input, y ) != 0 )
+    {
+      printf( "ERROR: unexpected EOF reached while reading\n" );
+      return EXIT_FAILURE;
+    }
+    if( feed_level( levels, level_count, 0, y, band_row( &input, y ) ) != 0 )
+    {
+      printf( "ERROR: unexpected EOF reached while writing\n" );
+      return EXIT_FAILURE;
+    }
+    int64_t count = 0;
+    for( int i = 0; i < level_count; i++ )
+    {
+      count += levels[i].count;
+    }
+    progress_update( &progress, 1, (int64_t)input_bin.width * 2, ( count - written ) * 2 );
+    written = count;
+  }
+  progress_stage( &progress, "close", 0 );
+  for( int i = 0; i < level_count; i++ )
+  {
+    level_t *l = &levels[i];
+    if( header )
+    {
+      rewind( l->file );
+      if( binfile_write_header( l->file, l->scaler.out_width, l->scaler.out_height, l->min, l->max ) != 0 )
       {
-        printf( "ERROR: unexpected EOF reached while writing 2\n" );
+        printf( "ERROR: unexpected EOF reached while writing header\n" );
         return EXIT_FAILURE;
       }
-      count++;
     }
+    if( fclose( l->file ) != 0 )
+    {
+      printf( "ERROR: unexpected EOF reached while writing\n" );
+      return EXIT_FAILURE;
+    }
+    printf( "%d values written", l->count );
+    if( level_count > 1 )
+    {
+      printf( " to %s, %d x %d", l->file_name, l->scaler.out_width, l->scaler.out_height );
+    }
+    printf( "\n" );
+    scaler_free( &l->scaler );
+  }
+  band_close( &input );
+  binfile_close( &input_bin );
+  progress_summary( &progress );
+  if( ( timing_file_name != NULL ) && ( progress_write_json( &progress, timing_file_name ) != 0 ) )
+  {
+    printf( "ERROR: could not write timing file: %s\n", timing_file_name );
+    return EXIT_FAILURE;
   }
-  printf( "%d values written\n", count );
+  progress_free( &progress );
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,354 @@
+// scale.c - Streaming downscaler for height grids
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "scale.h"
+
+#define WEIGHT_ONE ( 1 << SCALE_WEIGHT_BITS )
+#define LANCZOS_LOBES 3
+
+// ------------------------------------------------------------------------
+
+static double sinc( double x )
+{
+  if( x == 0.0 )
+  {
+    return 1.0;
+  }
+  return sin( M_PI * x ) / ( M_PI * x );
+}
+
+static double lanczos( double x )
+{
+  if( fabs( x ) >= LANCZOS_LOBES )
+  {
+    return 0.0;
+  }
+  return sinc( x ) * sinc( x / LANCZOS_LOBES );
+}
+
+static int clamp( int value, int min, int max )
+{
+  if( value < min )
+  {
+    return min;
+  }
+  if( value > max )
+  {
+    return max;
+  }
+  return value;
+}
+
+// ------------------------------------------------------------------------
+// Turn a set of weights into fixed point ones that add up to exactly
+// one, any rounding error goes on the largest weight
+
+static void quantise_weights( const double *weights, int taps, int16_t *out )
+{
+  double total = 0.0;
+  int sum = 0;
+  int largest = 0;
+
+  for( int k = 0; k < taps; k++ )
+  {
+    total += weights[k];
+  }
+  for( int k = 0; k < taps; k++ )
+  {
+    out[k] = lrint( weights[k] / total * WEIGHT_ONE );
+    sum += out[k];
+    if( weights[k] > weights[largest] )
+    {
+      largest = k;
+    }
+  }
+  out[largest] += WEIGHT_ONE - sum;
+}
+
+// ------------------------------------------------------------------------
+// Work out the weights for scaling in_size values down by factor
+
+static int filter_init( scale_filter_t *filter, scale_type_t type, int in_size, int factor )
+{
+  filter->out_size = ( in_size + factor - 1 ) / factor;
+  switch( type )
+  {
+    case SCALE_NEAREST:
+      filter->taps = 1;
+      break;
+    case SCALE_BOX:
+      filter->taps = factor;
+      break;
+    default:
+      filter->taps = 2 * LANCZOS_LOBES * factor;
+      break;
+  }
+  filter->first = malloc( filter->out_size * sizeof( int ) );
+  filter->weights = malloc( (size_t)filter->out_size * filter->taps * sizeof( int16_t ) );
+  double weights[filter->taps];
+  if( ( filter->first == NULL ) || ( filter->weights == NULL ) )
+  {
+    return -1;
+  }
+  for( int o = 0; o < filter->out_size; o++ )
+  {
+    int16_t *out = filter->weights + (size_t)o * filter->taps;
+    switch( type )
+    {
+      case SCALE_NEAREST:
+        filter->first[o] = o * factor;
+        out[0] = WEIGHT_ONE;
+        break;
+      case SCALE_BOX:
+        // The last block may be short
+        filter->first[o] = o * factor;
+        for( int k = 0; k < factor; k++ )
+        {
+          weights[k] = ( o * factor + k < in_size ) ? 1.0 : 0.0;
+        }
+        quantise_weights( weights, filter->taps, out );
+        break;
+      default:
+        {
+          // Centre of the block in input coordinates, the kernel is
+          // stretched by the scale factor
+          double centre = ( o + 0.5 ) * factor - 0.5;
+          filter->first[o] = (int)floor( centre - LANCZOS_LOBES * factor ) + 1;
+          for( int k = 0; k < filter->taps; k++ )
+          {
+            weights[k] = lanczos( ( filter->first[o] + k - centre ) / factor );
+          }
+          quantise_weights( weights, filter->taps, out );
+        }
+        break;
+    }
+  }
+  return 0;
+}
+
+static void filter_free( scale_filter_t *filter )
+{
+  free( filter->first );
+  free( filter->weights );
+  filter->first = NULL;
+  filter->weights = NULL;
+}
+
+// ------------------------------------------------------------------------
+// Last input row, after clamping, that output row o actually uses
+
+static int needed_row( const scaler_t *scaler, int o )
+{
+  const scale_filter_t *filter = &scaler->vertical;
+  const int16_t *weights = filter->weights + (size_t)o * filter->taps;
+  int k = filter->taps - 1;
+
+  while( ( k > 0 ) && ( weights[k] == 0 ) )
+  {
+    k--;
+  }
+  return clamp( filter->first[o] + k, 0, scaler->in_height - 1 );
+}
+
+// ------------------------------------------------------------------------
+
+int scale_type_from_name( const char *name, scale_type_t *type )
+{
+  if( strcmp( name, "nearest" ) == 0 )
+  {
+    *type = SCALE_NEAREST;
+    return 0;
+  }
+  if( strcmp( name, "box" ) == 0 )
+  {
+    *type = SCALE_BOX;
+    return 0;
+  }
+  if( strcmp( name, "lanczos" ) == 0 )
+  {
+    *type = SCALE_LANCZOS;
+    return 0;
+  }
+  return -1;
+}
+
+// ------------------------------------------------------------------------
+
+int scaler_init( scaler_t *scaler, scale_type_t type, int in_width, int in_height, int factor )
+{
+  memset( scaler, 0, sizeof( *scaler ) );
+  scaler->in_width = in_width;
+  scaler->in_height = in_height;
+  scaler->last_row = -1;
+  scaler->next_out = 0;
+  if( ( filter_init( &scaler->horizontal, type, in_width, factor ) != 0 ) ||
+      ( filter_init( &scaler->vertical, type, in_height, factor ) != 0 ) )
+  {
+    scaler_free( scaler );
+    return -1;
+  }
+  scaler->out_width = scaler->horizontal.out_size;
+  scaler->out_height = scaler->vertical.out_size;
+
+  // Enough wrapped values either side of the row that every output
+  // value can use consecutive inputs
+  const scale_filter_t *h = &scaler->horizontal;
+  for( int o = 0; o < h->out_size; o++ )
+  {
+    if( -h->first[o] > scaler->pad )
+    {
+      scaler->pad = -h->first[o];
+    }
+    if( h->first[o] + h->taps - in_width > scaler->pad )
+    {
+      scaler->pad = h->first[o] + h->taps - in_width;
+    }
+  }
+
+  scaler->wanted = calloc( in_height, 1 );
+  scaler->padded = malloc( ( in_width + 2 * (size_t)scaler->pad ) * sizeof( int16_t ) );
+  scaler->ring = malloc( (size_t)scaler->vertical.taps * scaler->out_width * sizeof( int16_t ) );
+  scaler->sums = malloc( scaler->out_width * sizeof( int32_t ) );
+  scaler->out_row = malloc( scaler->out_width * sizeof( int16_t ) );
+  if( ( scaler->wanted == NULL ) || ( scaler->padded == NULL ) || ( scaler->ring == NULL ) ||
+      ( scaler->sums == NULL ) || ( scaler->out_row == NULL ) )
+  {
+    scaler_free( scaler );
+    return -1;
+  }
+  const scale_filter_t *v = &scaler->vertical;
+  for( int o = 0; o < v->out_size; o++ )
+  {
+    for( int k = 0; k < v->taps; k++ )
+    {
+      if( v->weights[(size_t)o * v->taps + k] != 0 )
+      {
+        scaler->wanted[clamp( v->first[o] + k, 0, in_height - 1 )] = 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------------------
+// Rows that no output uses don't need to be read or pushed in
+
+int scaler_wants_row( const scaler_t *scaler, int y )
+{
+  return scaler->wanted[y];
+}
+
+// ------------------------------------------------------------------------
+// Scale a row horizontally into the ring, rows must be pushed in order
+
+void scaler_push_row( scaler_t *scaler, int y, const int16_t *row )
+{
+  const scale_filter_t *h = &scaler->horizontal;
+  int width = scaler->in_width;
+  int pad = scaler->pad;
+  int16_t *padded = scaler->padded + pad;
+
+  // Wrap round in longitude
+  memcpy( padded, row, width * sizeof( int16_t ) );
+  for( int i = 1; i <= pad; i++ )
+  {
+    padded[-i] = row[( ( -i % width ) + width ) % width];
+    padded[width - 1 + i] = row[( i - 1 ) % width];
+  }
+
+  int16_t *out = scaler->ring + (size_t)( y % scaler->vertical.taps ) * scaler->out_width;
+  for( int o = 0; o < h->out_size; o++ )
+  {
+    const int16_t *in = padded + h->first[o];
+    const int16_t *weights = h->weights + (size_t)o * h->taps;
+    int32_t sum = WEIGHT_ONE / 2;
+    for( int k = 0; k < h->taps; k++ )
+    {
+      sum += weights[k] * in[k];
+    }
+    out[o] = clamp( sum >> SCALE_WEIGHT_BITS, INT16_MIN, INT16_MAX );
+  }
+  scaler->last_row = y;
+}
+
+// ------------------------------------------------------------------------
+// Make the next output row if all of its input rows have been pushed
+// in, returns NULL if not.  The row is only valid until the next call
+
+const int16_t *scaler_next_row( scaler_t *scaler, int *y )
+{
+  const scale_filter_t *v = &scaler->vertical;
+  int o = scaler->next_out;
+  int width = scaler->out_width;
+
+  if( ( o >= scaler->out_height ) || ( needed_row( scaler, o ) > scaler->last_row ) )
+  {
+    return NULL;
+  }
+  // Accumulate whole rows at a time so that the compiler can use
+  // vector instructions
+  int32_t *sums = scaler->sums;
+  for( int x = 0; x < width; x++ )
+  {
+    sums[x] = WEIGHT_ONE / 2;
+  }
+  const int16_t *weights = v->weights + (size_t)o * v->taps;
+  for( int k = 0; k < v->taps; k++ )
+  {
+    int32_t weight = weights[k];
+    if( weight == 0 )
+    {
+      continue;
+    }
+    int row = clamp( v->first[o] + k, 0, scaler->in_height - 1 );
+    const int16_t *in = scaler->ring + (size_t)( row % v->taps ) * width;
+    for( int x = 0; x < width; x++ )
+    {
+      sums[x] += weight * in[x];
+    }
+  }
+  for( int x = 0; x < width; x++ )
+  {
+    scaler->out_row[x] = clamp( sums[x] >> SCALE_WEIGHT_BITS, INT16_MIN, INT16_MAX );
+  }
+  *y = o;
+  scaler->next_out++;
+  return scaler->out_row;
+}
+
+// ------------------------------------------------------------------------
+
+void scaler_free( scaler_t *scaler )
+{
+  filter_free( &scaler->horizontal );
+  filter_free( &scaler->vertical );
+  free( scaler->wanted );
+  free( scaler->padded );
+  free( scaler->ring );
+  free( scaler->sums );
+  free( scaler->out_row );
+  scaler->wanted = NULL;
+  scaler->padded = NULL;
+  scaler->ring = NULL;
+  scaler->sums = NULL;
+  scaler->out_row = NULL;
+}
@@ -0,0 +1,72 @@
+// scale.h - Streaming downscaler for height grids
+// Copyright (C) 2026 John Davies
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+
+// Filters for working out each output value
+typedef enum
+{
+  SCALE_NEAREST,   // first input value of each block
+  SCALE_BOX,       // average of each block
+  SCALE_LANCZOS    // 3 lobe Lanczos
+} scale_type_t;
+
+// Weights are fixed point with this many fraction bits
+#define SCALE_WEIGHT_BITS 14
+
+// Weights for one direction, output value o is the weighted sum of
+// input values first[o] to first[o] + taps - 1
+typedef struct
+{
+  int out_size;
+  int taps;
+  int *first;
+  int16_t *weights;  // out_size * taps
+} scale_filter_t;
+
+// Scales a grid down by a whole number factor.  Rows are pushed in one
+// at a time, south first, and output rows are taken out as soon as all
+// of the rows they need have arrived.  Longitude wraps round at the
+// edges and latitude is clamped at the poles
+typedef struct
+{
+  int in_width;
+  int in_height;
+  int out_width;
+  int out_height;
+  scale_filter_t horizontal;
+  scale_filter_t vertical;
+  unsigned char *wanted; // input rows that are used, in_height flags
+  int pad;            // wrapped values either side of the input row
+  int16_t *padded;    // in_width + 2 * pad values
+  int16_t *ring;      // last vertical.taps rows, horizontally scaled
+  int32_t *sums;      // out_width values
+  int16_t *out_row;   // out_width values
+  int last_row;       // last input row pushed in
+  int next_out;       // next output row to make
+} scaler_t;
+
+int scale_type_from_name( const char *name, scale_type_t *type );
+int scaler_init( scaler_t *scaler, scale_type_t type, int in_width, int in_height, int factor );
+int scaler_wants_row( const scaler_t *scaler, int y );
+void scaler_push_row( scaler_t *scaler, int y, const int16_t *row );
+const int16_t *scaler_next_row( scaler_t *scaler, int *y );
+void scaler_free( scaler_t *scaler );
+
+#endif
@@ -17,39 +17,288 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tiffio.h"
+#include "binfile.h"
+#include "progress.h"
 
-int main( int argc, char *argv[] )
+// Everything the decode threads need, read only once set up
+typedef struct
 {
-  FILE* input_file;
-  FILE* output_file;
+  const char *file_name;
+  uint32_t width;
+  uint32_t length;
+  int tiled;
+  uint32_t chunk_width;   // tile size, or image width for strips
+  uint32_t chunk_length;  // tile or strip rows
+  uint32_t chunks;
+  int16_t *grid;          // whole image, top row first
+  progress_t *progress;   // shared by the threads
+} image_t;
 
-  printf( "tif2bin, v0.1\n" );
+// Work for one thread.  Decoding takes chunks index, index + threads ...
+// and gives back the range of the values it saw.  Writing converts
+// output rows first_row to last_row - 1
+typedef struct
+{
+  const image_t *image;
+  int index;
+  int threads;
+  int min;
+  int max;
+  int status;
+  // Write pass
+  unsigned char *dest;
+  int first_row;
+  int last_row;
+  int offset;
+} job_t;
 
-  // Check command line
-  if( argc != 3 )
+// ------------------------------------------------------------------------
+// Decode this thread's strips or tiles into the grid.  libtiff handles
+// can't be shared between threads so each one opens the file itself
+
+static void *decode_worker( void *arg )
+{
+  job_t *job = arg;
+  const image_t *image = job->image;
+  int16_t *tile = NULL;
+
+  job->status = -1;
+  job->min = INT_MAX;
+  job->max = INT_MIN;
+  TIFF *tif = TIFFOpen( image->file_name, "r" );
+  if( tif == NULL )
+  {
+    return NULL;
+  }
+  if( image->tiled )
+  {
+    tile = _TIFFmalloc( TIFFTileSize( tif ) );
+    if( tile == NULL )
+    {
+      TIFFClose( tif );
+      return NULL;
+    }
+  }
+  uint32_t across = ( image->width + image->chunk_width - 1 ) / image->chunk_width;
+  for( uint32_t chunk = job->index; chunk < image->chunks; chunk += job->threads )
+  {
+    uint32_t x0 = ( chunk % across ) * image->chunk_width;
+    uint32_t y0 = ( chunk / across ) * image->chunk_length;
+    uint32_t columns = image->chunk_width;
+    uint32_t rows = image->chunk_length;
+    if( x0 + columns > image->width )
+    {
+      columns = image->width - x0;
+    }
+    if( y0 + rows > image->length )
+    {
+      rows = image->length - y0;
+    }
+    int16_t *dest = image->grid + (size_t)y0 * image->width + x0;
+    if( image->tiled )
+    {
+      // Tiles are always full size so copy out the part in the image
+      if( TIFFReadEncodedTile( tif, chunk, tile, (tmsize_t)-1 ) < 0 )
+      {
+        _TIFFfree( tile );
+        TIFFClose( tif );
+        return NULL;
+      }
+      for( uint32_t y = 0; y < rows; y++ )
+      {
+        memcpy( dest + (size_t)y * image->width, tile + (size_t)y * image->chunk_width,
+                columns * sizeof( int16_t ) );
+      }
+    }
+    else
+    {
+      // Strips are whole rows so decode straight into the grid
+      if( TIFFReadEncodedStrip( tif, chunk, dest, (tmsize_t)rows * image->width * sizeof( int16_t ) ) < 0 )
+      {
+        TIFFClose( tif );
+        return NULL;
+      }
+    }
+    for( uint32_t y = 0; y < rows; y++ )
+    {
+      const int16_t *row = dest + (size_t)y * image->width;
+      for( uint32_t x = 0; x < columns; x++ )
+      {
+        if( row[x] > job->max )
+        {
+          job->max = row[x];
+        }
+        if( row[x] < job->min )
+        {
+          job->min = row[x];
+        }
+      }
+    }
+    // Rows are counted with the last tile across
+    if( x0 + columns == image->width )
+    {
+      progress_update( image->progress, rows, 0, 0 );
+    }
+  }
+  if( tile != NULL )
   {
-    printf( "ERROR: usage is: tif2bin <input file> <output file>\n" );
+    _TIFFfree( tile );
+  }
+  TIFFClose( tif );
+  job->status = 0;
+  return NULL;
+}
 
-    return EXIT_FAILURE;
+// ------------------------------------------------------------------------
+// Offset and convert rows into the output file.  The output starts
+// with the bottom row of the image
+
+static void *write_worker( void *arg )
+{
+  job_t *job = arg;
+  const image_t *image = job->image;
+  int16_t *row = malloc( image->width * sizeof( int16_t ) );
+
+  job->status = -1;
+  if( row == NULL )
+  {
+    return NULL;
+  }
+  for( int y = job->first_row; y < job->last_row; y++ )
+  {
+    const int16_t *in = image->grid + (size_t)( image->length - 1 - y ) * image->width;
+    for( uint32_t x = 0; x < image->width; x++ )
+    {
+      // Scale the value
+      row[x] = in[x] - job->offset;
+    }
+    binfile_put_values( job->dest + (size_t)y * image->width * 2, row, image->width );
+    progress_update( image->progress, 1, 0, (int64_t)image->width * 2 );
   }
+  free( row );
+  job->status = 0;
+  return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Run a worker on each job, in this thread if a new one can't be made
 
-  // Check output file
-  output_file = fopen( argv[2], "w" );
-  if( output_file == NULL )
+static int run_jobs( job_t *jobs, int threads, void *(*worker)( void * ) )
+{
+  pthread_t ids[threads];
+
+  for( int i = 0; i < threads; i++ )
   {
-    printf( "ERROR: could not open output file: %s\n", argv[2] );
-    return EXIT_FAILURE;
+    if( pthread_create( &ids[i], NULL, worker, &jobs[i] ) != 0 )
+    {
+      ids[i] = pthread_self();
+      worker( &jobs[i] );
+    }
   }
+  int status = 0;
+  for( int i = 0; i < threads; i++ )
+  {
+    if( !pthread_equal( ids[i], pthread_self() ) )
+    {
+      pthread_join( ids[i], NULL );
+    }
+    if( jobs[i].status != 0 )
+    {
+      status = -1;
+    }
+  }
+  return status;
+}
+
+// ------------------------------------------------------------------------
+
+static void usage( void )
+{
+  printf( "ERROR: usage is: tif2bin [options] <input file> <output file>\n" );
+  printf( "  Options:\n" );
+  printf( "    -R                raw output, without the header giving the size and\n" );
+  printf( "                      range of the data\n" );
+  printf( "    -t threads        number of threads, default is one per CPU\n" );
+  printf( "    -i seconds        print progress every this many seconds\n" );
+  printf( "    -J file           write the time taken by each stage to file as JSON\n" );
+}
+
+// ------------------------------------------------------------------------
 
-  // Check input file
-  input_file = fopen( argv[1], "r" );
-  if( input_file == NULL )
+int main( int argc, char *argv[] )
+{
+  int header = 1;
+  int threads = sysconf( _SC_NPROCESSORS_ONLN );
+  double progress_interval = 0.0;
+  char *timing_file_name = NULL;
+  int opt;
+
+  printf( "tif2bin, v0.3\n" );
+  if( threads < 1 )
   {
-    printf( "ERROR: could not open input file: %s\n", argv[1] );
+    threads = 1;
+  }
+
+  // Check options
+  while( ( opt = getopt( argc, argv, "+HRt:i:J:" ) ) != -1 )
+  {
+    switch( opt )
+    {
+      case 'H':
+        // Headers are written by default now, kept for old scripts
+        header = 1;
+        break;
+      case 'R':
+        header = 0;
+        break;
+      case 't':
+        threads = atoi( optarg );
+        if( threads < 1 )
+        {
+          printf( "ERROR: invalid number of threads: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'i':
+        progress_interval = atof( optarg );
+        if( progress_interval <= 0.0 )
+        {
+          printf( "ERROR: invalid progress interval: %s\n", optarg );
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'J':
+        timing_file_name = optarg;
+        break;
+      default:
+        usage();
+        return EXIT_FAILURE;
+    }
+  }
+  // Skip over the options so that the positional arguments are
+  // numbered as before
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check command line
+  if( argc != 3 )
+  {
+    usage();
     return EXIT_FAILURE;
   }
+  progress_t progress;
+  progress_init( &progress, "tif2bin", progress_interval );
+  progress_stage( &progress, "setup", 0 );
+
   // Read input file
   TIFF* tif = TIFFOpen( argv[1], "r" );
   // Check number of images in file
@@ -71,63 +320,154 @@ int main( int argc, char *argv[] )
     printf( "ERROR: could not read TIFF file: %s\n", argv[1] );
     return EXIT_FAILURE;
   }
-  //
-  uint32 imagelength;
-  int nsamples;
-	tdata_t buf;
-	uint32 TIFFrow;
+  // Only single channel 16 bit images can be converted
+  image_t image;
+  image.progress = &progress;
+  uint16_t nsamples = 1;
+  uint16_t bits = 0;
+  image.file_name = argv[1];
+  TIFFGetField( tif, TIFFTAG_IMAGEWIDTH, &image.width );
+  TIFFGetField( tif, TIFFTAG_IMAGELENGTH, &image.length );
+  TIFFGetFieldDefaulted( tif, TIFFTAG_SAMPLESPERPIXEL, &nsamples );
+  TIFFGetFieldDefaulted( tif, TIFFTAG_BITSPERSAMPLE, &bits );
+  if( ( nsamples != 1 ) || ( bits != 16 ) )
+  {
+    printf( "ERROR: TIFF file must have one 16 bit sample per pixel, found %d x %d bits\n", nsamples, bits );
+    return EXIT_FAILURE;
+  }
+  // Strips and tiles are both decoded as rectangular chunks, any
+  // compression is handled by libtiff
+  image.tiled = TIFFIsTiled( tif );
+  if( image.tiled )
+  {
+    TIFFGetField( tif, TIFFTAG_TILEWIDTH, &image.chunk_width );
+    TIFFGetField( tif, TIFFTAG_TILELENGTH, &image.chunk_length );
+    image.chunks = TIFFNumberOfTiles( tif );
+  }
+  else
+  {
+    image.chunk_width = image.width;
+    TIFFGetFieldDefaulted( tif, TIFFTAG_ROWSPERSTRIP, &image.chunk_length );
+    if( image.chunk_length > image.length )
+    {
+      image.chunk_length = image.length;
+    }
+    image.chunks = TIFFNumberOfStrips( tif );
+  }
+  printf( "%d x %d pixels, %d %s of %d x %d\n", image.width, image.length, image.chunks,
+          image.tiled ? "tiles" : "strips", image.chunk_width, image.chunk_length );
+  TIFFClose( tif );
+  if( image.chunks == 0 )
+  {
+    printf( "ERROR: TIFF file has no strips or tiles: %s\n", argv[1] );
+    return EXIT_FAILURE;
+  }
+  if( threads > (int)image.chunks )
+  {
+    threads = image.chunks;
+  }
 
-	TIFFGetField( tif, TIFFTAG_IMAGELENGTH, &imagelength );
-  TIFFGetField( tif, TIFFTAG_SAMPLESPERPIXEL, &nsamples );
-  printf( "%d rows read, sample size: %d, line size: %ld\n", imagelength, nsamples, TIFFScanlineSize( tif ) );
-	buf = _TIFFmalloc( TIFFScanlineSize( tif ) );
+  // Decode the whole image once, the range is found at the same time
+  // and the decoded values are kept for writing out
+  image.grid = malloc( (size_t)image.width * image.length * sizeof( int16_t ) );
+  if( image.grid == NULL )
+  {
+    printf( "ERROR: could not allocate image buffer\n" );
+    return EXIT_FAILURE;
+  }
+  job_t jobs[threads];
+  for( int i = 0; i < threads; i++ )
+  {
+    jobs[i].image = &image;
+    jobs[i].index = i;
+    jobs[i].threads = threads;
+  }
+  printf( "Reading using %d thread(s)\n", threads );
+  progress_stage( &progress, "decode", image.length );
+  struct stat st;
+  if( stat( argv[1], &st ) == 0 )
+  {
+    progress_update( &progress, 0, st.st_size, 0 );
+  }
+  if( run_jobs( jobs, threads, decode_worker ) != 0 )
+  {
+    printf( "ERROR: could not decode TIFF file: %s\n", argv[1] );
+    return EXIT_FAILURE;
+  }
   int max = INT_MIN;
   int min = INT_MAX;
-  // First pass through to get min/max values
-  for( TIFFrow = 0; TIFFrow < imagelength; TIFFrow++)
+  for( int i = 0; i < threads; i++ )
   {
-	    TIFFReadScanline( tif, buf, TIFFrow, 0 );
-      // Step through line data
-      for( uint32 idx=0; idx<TIFFScanlineSize( tif ); idx+=2 )
-      {
-        int16 val = *((int16 *)( buf + idx ));
-        if( val > max )
-        {
-          max = val;
-        }
-        if( val < min )
-        {
-          min = val;
-        }
-      }
+    if( jobs[i].max > max )
+    {
+      max = jobs[i].max;
+    }
+    if( jobs[i].min < min )
+    {
+      min = jobs[i].min;
+    }
   }
-  // Second pass to write the data
+  printf( "%d rows read\n", image.length );
   printf( "Minimum value: %d, maximum value: %d\n", min, max );
   printf( "Adding offset of: %d\n", -min );
-	for( TIFFrow = 0; TIFFrow < imagelength; TIFFrow++)
+
+  // The output is written in place through a mapping so that the
+  // threads can each fill in their own rows
+  progress_stage( &progress, "write", image.length );
+  size_t header_size = header ? BINFILE_HEADER_SIZE : 0;
+  size_t output_size = header_size + (size_t)image.width * image.length * 2;
+  int fd = open( argv[2], O_RDWR | O_CREAT | O_TRUNC, 0644 );
+  if( fd < 0 )
   {
-	    TIFFReadScanline( tif, buf, ( imagelength - TIFFrow - 1 ), 0 );
-      // Step through line data
-      for( uint32 idx=0; idx<TIFFScanlineSize( tif ); idx+=2 )
-      {
-        int16 val = *((int16 *)( buf + idx ));
-        // Scale the value
-        val = val - min;
-        // Output data
-        if( fputc( val >> 8, output_file ) == EOF )
-        {
-          printf( "ERROR: unexpected EOF reached while writing 1\n" );
-          return EXIT_FAILURE;
-        }
-        if( fputc( val, output_file ) == EOF )
-        {
-          printf( "ERROR: unexpected EOF reached while writing 2\n" );
-          return EXIT_FAILURE;
-        }
-      }
+    printf( "ERROR: could not open output file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+  if( ftruncate( fd, output_size ) != 0 )
+  {
+    printf( "ERROR: unexpected EOF reached while writing\n" );
+    return EXIT_FAILURE;
+  }
+  unsigned char *output = mmap( NULL, output_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  if( output == MAP_FAILED )
+  {
+    printf( "ERROR: could not map output file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+  if( header )
+  {
+    binfile_make_header( output, image.width, image.length, 0, (int16_t)( max - min ) );
+  }
+  int rows_per_job = ( image.length + threads - 1 ) / threads;
+  for( int i = 0; i < threads; i++ )
+  {
+    jobs[i].dest = output + header_size;
+    jobs[i].offset = min;
+    jobs[i].first_row = i * rows_per_job;
+    jobs[i].last_row = ( i + 1 ) * rows_per_job;
+    if( jobs[i].last_row > (int)image.length )
+    {
+      jobs[i].last_row = image.length;
+    }
+  }
+  if( run_jobs( jobs, threads, write_worker ) != 0 )
+  {
+    printf( "ERROR: could not write output file: %s\n", argv[2] );
+    return EXIT_FAILURE;
+  }
+  progress_stage( &progress, "close", 0 );
+  if( ( munmap( output, output_size ) != 0 ) || ( close( fd ) != 0 ) )
+  {
+    printf( "ERROR: unexpected EOF reached while writing\n" );
+    return EXIT_FAILURE;
+  }
+  free( image.grid );
+  progress_summary( &progress );
+  if( ( timing_file_name != NULL ) && ( progress_write_json( &progress, timing_file_name ) != 0 ) )
+  {
+    printf( "ERROR: could not write timing file: %s\n", timing_file_name );
+    return EXIT_FAILURE;
   }
-	_TIFFfree(buf);
-  TIFFClose(tif);
+  progress_free( &progress );
 
   return EXIT_SUCCESS;
 }